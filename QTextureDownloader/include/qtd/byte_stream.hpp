@@ -0,0 +1,45 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <streambuf>
+#include <string>
+
+namespace qtd
+{
+
+// bytes waiting to be read before the feeding thread is blocked
+constexpr size_t BYTE_STREAM_MAX_BUFFERED = 4 * 1024 * 1024;
+
+// stream buffer fed by chunks of data from one thread (the network) and read from
+// another one (a parser). Reading blocks until data are available or until the stream
+// is closed. Feeding blocks while 'max_buffered' bytes are waiting to be read, so that
+// a slow reader bounds the memory used, and stops once the reader is done
+class ByteStreamBuffer : public std::streambuf
+{
+public:
+  explicit ByteStreamBuffer(size_t max_buffered_ = BYTE_STREAM_MAX_BUFFERED);
+
+  void close();  // end of stream, no more data
+  void finish(); // reader done (end of document or error), no more data wanted
+
+  // false once the reader is done, the data are then dropped
+  bool push(const char *data, size_t size);
+
+protected:
+  int_type underflow() override;
+
+private:
+  std::mutex              mutex;
+  std::condition_variable cv;
+  std::deque<std::string> chunks;
+  std::string             current; // chunk being read
+  size_t                  buffered = 0;
+  size_t                  max_buffered;
+  bool                    closed = false;
+  bool                    finished = false;
+};
+
+} // namespace qtd
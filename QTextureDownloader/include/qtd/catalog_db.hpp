@@ -0,0 +1,73 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+
+#include "qtd/texture.hpp"
+
+namespace qtd
+{
+
+// --------------------------
+// CatalogQuery
+// --------------------------
+
+// filters of a catalog query, empty or unset fields are not filtered on. For instance
+// all the pinned assets with a 4k normal map: {.is_pinned = 1, .types =
+// {TextureType::NORMAL}, .res = TextureRes::R4K}
+struct CatalogQuery
+{
+  std::string              source;
+  std::string              tag;
+  int                      is_pinned = -1; // -1: any, 0: unpinned, 1: pinned
+  std::vector<TextureType> types;          // maps which must all be available...
+  TextureRes               res = TextureRes::RUNKNOWN; // ...at this resolution, if set
+  bool                     downloaded = false;         // ...and on disk
+};
+
+// --------------------------
+// CatalogDb
+// --------------------------
+
+// embedded SQLite catalog: assets, tags and texture files tables, indexed on the
+// source, tags, pinned state and available resolutions, so that the catalog can be
+// queried without being loaded. Optional, only available if built with
+// QTD_ENABLE_SQLITE (every method fails otherwise)
+class CatalogDb
+{
+public:
+  explicit CatalogDb(const std::string &db_path_ = "");
+
+  static bool is_available(); // built with SQLite support
+
+  int  count() const; // number of assets, -1 on error
+  bool get_texture(const std::string &id, Texture &texture) const;
+  bool is_open() const;
+  bool open();
+
+  // inserts or updates the given assets and removes the others, in one transaction.
+  // Unchanged assets (same fingerprint and pinned state) are skipped. The download
+  // state of the files is kept, the files an asset does not offer anymore are removed.
+  // The details loaded for the import are released afterwards
+  bool import_textures(TextureMap &textures);
+
+  // download state of all the files, in one transaction: the files in 'paths' (path by
+  // file name) are downloaded, the others are not. Only the rows that differ are written
+  bool import_file_states(const std::map<std::string, std::string> &paths);
+
+  std::vector<std::string> query(const CatalogQuery &query) const; // asset IDs
+
+  // single row updates, each one being its own transaction. 'name' is the texture
+  // file name (see TextureKey::to_string)
+  bool set_file_state(const std::string &name, const std::string &path, bool downloaded);
+  bool set_pinned(const std::string &id, bool new_state);
+
+private:
+  // --- Members
+  std::string db_path;
+  std::string connection_name; // set once open
+};
+
+} // namespace qtd
@@ -1,7 +1,10 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
 #pragma once
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <QSize>
 
@@ -22,6 +25,77 @@ public:
     QSize thumbnail_size = QSize(64, 64);
   } widget;
 
+  struct Network
+  {
+    std::string user_agent = "QTextureDownloader";
+
+    // connections opened at startup
+    std::vector<std::string> preconnect_hosts = {"api.polyhaven.com",
+                                                 "dl.polyhaven.org",
+                                                 "cdn.polyhaven.com"};
+
+    int max_requests_in_flight = 16;
+    int max_requests_per_host = 8;
+    int read_buffer_size = 256 * 1024; // bytes, per download
+
+    // bandwidth limits in bytes/s (0 to disable), shared by all the transfers of a
+    // given class. Can be changed at runtime, see RateLimiter::set_max_rate
+    int64_t max_rate_foreground = 0;
+    int64_t max_rate_background = 0;
+
+    // timeouts (0 to disable)
+    int connect_timeout_ms = 10000; // until the response headers are received
+    int idle_timeout_ms = 20000;    // without receiving any data
+    int total_timeout_ms = 0;       // whole transfer
+
+    // retries of transient failures, exponential backoff with jitter
+    int max_retries = 3;
+    int retry_backoff_ms = 500;
+    int retry_backoff_max_ms = 30000;
+  } network;
+
+  struct Mirror
+  {
+    // local directory or base url of a LAN HTTP server mirroring the upstream files,
+    // tried first with a fallback to upstream (disabled if empty)
+    std::string location = "";
+    bool        metadata = false; // JSON documents as well, only as fresh as the mirror
+  } mirror;
+
+  struct Prefetch
+  {
+    // pinned materials are downloaded in the background while the application is idle,
+    // at the current resolution first, then at the neighboring ones
+    bool    enabled = true;
+    int     idle_delay_ms = 10000;                // without user input nor downloads
+    int     neighbor_resolutions = 1;             // on each side of the current one
+    int64_t max_bytes = 4LL * 1024 * 1024 * 1024; // disk budget, files to prefetch
+
+    // the bandwidth used is the one of the background transfers, see
+    // Config::network.max_rate_background
+  } prefetch;
+
+  struct Storage
+  {
+    // store texture files by content hash, identical files are stored only once
+    bool content_addressed = false;
+
+    // disk budget of the texture files in bytes (0 for no limit). Once exceeded, the
+    // least recently used files of the unpinned textures are evicted
+    int64_t max_bytes = 0;
+
+    // catalog mirrored to an SQLite database for indexed queries, requires a build
+    // with QTD_ENABLE_SQLITE (see CatalogDb)
+    bool sqlite = false;
+  } storage;
+
+  struct Update
+  {
+    bool incremental = true; // only fetch new or modified assets
+    int  failure_backoff_s = 3600;
+    int  failure_backoff_max_s = 7 * 24 * 3600;
+  } update;
+
 private:
   Config(const Config &) = delete;
   Config &operator=(const Config &) = delete;
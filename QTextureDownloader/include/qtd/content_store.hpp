@@ -0,0 +1,58 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace qtd
+{
+
+// content-addressed storage: each distinct content is stored once, named after its
+// hash ('<root>/objects/ab/abcd...<ext>'), and an index maps file names to contents
+class ContentStore
+{
+public:
+  explicit ContentStore(const std::string &root_path_ = "");
+
+  bool        contains(std::string_view name) const;
+  std::string get_path(std::string_view name) const; // empty if not stored
+  bool        is_enabled() const;
+
+  // stores the file under 'name' and returns its path in the store (empty on error).
+  // The source file is moved, unless 'keep_source' is set, in which case it is
+  // hardlinked, reflinked or copied (in that order of preference). The previous
+  // content of 'name', if any, is released (see remove)
+  std::string ingest(const std::string &name,
+                     const std::string &file_path,
+                     bool               keep_source = false);
+
+  // imports the files of a directory (with the given extension and accepted by the
+  // filter, if any) not in the store yet, returns the count
+  int import_directory(
+      const std::string                              &dir_path,
+      const std::string                              &extension,
+      const std::function<bool(const std::string &)> &filter = nullptr,
+      bool                                            keep_source = false);
+
+  void load();
+
+  // removes 'name' from the index, the content itself is deleted once no other name
+  // refers to it. Returns the number of bytes freed
+  int64_t remove(const std::string &name);
+
+  void save() const;
+
+private:
+  std::string object_path(const std::string &hash, const std::string &extension) const;
+
+  // --- Members
+  std::string root_path;
+
+  // name => object path, relative to root
+  std::map<std::string, std::string, std::less<>> index;
+};
+
+} // namespace qtd
@@ -0,0 +1,189 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <array>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <QByteArray>
+#include <QEventLoop>
+#include <QNetworkReply>
+#include <QObject>
+#include <QPointer>
+
+#include "nlohmann/json.hpp"
+
+#include "qtd/http_cache.hpp"
+#include "qtd/network_policy.hpp"
+
+namespace qtd
+{
+
+enum class DownloadPriority : int
+{
+  BACKGROUND, // thumbnails, prefetching...
+  NORMAL,
+  USER, // explicitely requested by the user, preempts everything else
+};
+
+// received bytes, total bytes (-1 if unknown)
+using DownloadProgressCallback = std::function<void(int64_t, int64_t)>;
+
+// expected content of a downloaded file, checked before it is moved in place
+struct FileCheck
+{
+  int64_t     size = 0; // bytes, not checked if 0
+  std::string md5;      // hex digest, not checked if empty
+
+  // bytes available on disk (0 for no limit), the transfer is aborted as soon as the
+  // announced length (Content-Length) or the data received exceed it
+  int64_t max_size = 0;
+};
+
+// --------------------------
+// DownloadScheduler
+// --------------------------
+
+// asynchronous downloads with bounded global and per-host concurrency. Pending
+// requests are started by priority, and identical requests (same url and same
+// destination) are coalesced into a single transfer. Transient failures are retried
+// following the network policy, and background requests are read within their own
+// bandwidth budget (see RateLimiter). Callbacks are called in the scheduler thread as
+// soon as their transfer is done, and can submit new requests
+class DownloadScheduler : public QObject
+{
+  Q_OBJECT
+public:
+  using Callback = std::function<void(bool ok, const QByteArray &data)>;
+  using FileCallback = std::function<void(bool ok)>;
+  using JsonCallback = std::function<void(bool ok, const nlohmann::json &json)>;
+  using SaxHandler = nlohmann::json_sax<nlohmann::json>;
+
+  explicit DownloadScheduler(QObject *parent = nullptr);
+
+  // application-wide instance, shared by all the callers so that their requests are
+  // scheduled (and coalesced) together
+  static DownloadScheduler *get_scheduler();
+
+  bool is_idle() const;
+
+  // in memory
+  void submit(const std::string &url, DownloadPriority priority, Callback callback);
+
+  // JSON document, revalidated against the HTTP cache if enabled
+  void submit_json(const std::string &url,
+                   DownloadPriority   priority,
+                   JsonCallback       callback,
+                   const HttpCache   &cache = HttpCache());
+
+  // JSON document fed to a SAX 'handler' once received, no document is built. The
+  // handler is called in the scheduler thread, right before the callback
+  void submit_sax(const std::string          &url,
+                  DownloadPriority            priority,
+                  std::shared_ptr<SaxHandler> handler,
+                  FileCallback                callback,
+                  const HttpCache            &cache = HttpCache());
+
+  // streamed to disk through a resumable '.part' file, atomically renamed to
+  // 'file_path' once complete. The data are hashed while streaming, a file which does
+  // not match 'check' is discarded and downloaded again
+  void submit_file(const std::string       &url,
+                   const std::string       &file_path,
+                   DownloadPriority         priority,
+                   FileCallback             callback,
+                   DownloadProgressCallback progress_callback = nullptr,
+                   const FileCheck         &check = FileCheck());
+
+signals:
+  void idle();
+
+private:
+  using JobCallback =
+      std::function<void(bool ok, const QByteArray &data, const nlohmann::json &json)>;
+
+  struct Job
+  {
+    std::string                           key; // identical requests share the same key
+    std::string                           url;
+    std::string                           mirror_url; // tried first if not empty
+    std::string                           host;       // of the url in use
+    std::string                           file_path; // file jobs only
+    FileCheck                             check;     // file jobs only
+    bool                                  is_json = false;
+    bool                                  is_sax = false; // raw JSON text
+    HttpCache                             cache;
+    DownloadPriority                      priority = DownloadPriority::NORMAL;
+    bool                                  started = false;
+    int                                   attempt = 0;
+    bool                                  retry_scheduled = false;
+    std::vector<JobCallback>              callbacks;
+    std::vector<DownloadProgressCallback> progress_callbacks;
+  };
+
+  struct PartFile; // file jobs transfer state
+
+  void finish_job(const std::shared_ptr<Job> &job,
+                  bool                        ok,
+                  const QByteArray           &data,
+                  const nlohmann::json       &json);
+  void on_reply_finished(const std::shared_ptr<Job>      &job,
+                         QNetworkReply                   *reply,
+                         const ReplyWatchdog             *watchdog,
+                         ThrottledReader                 *reader,
+                         const std::shared_ptr<PartFile> &part);
+  std::shared_ptr<Job> pop_next_job();
+  void                 retry_job(const std::shared_ptr<Job> &job, int delay_ms);
+  void                 start_job(const std::shared_ptr<Job> &job);
+  void                 start_pending();
+  void                 submit_job(const std::shared_ptr<Job> &new_job);
+
+  // --- Members
+  std::map<std::string, std::shared_ptr<Job>>     jobs;    // pending and in flight
+  std::array<std::deque<std::shared_ptr<Job>>, 3> pending; // per priority
+  std::map<std::string, int>                      in_flight_per_host;
+  int                                             in_flight = 0;
+
+  static QPointer<DownloadScheduler> instance;
+};
+
+// --------------------------
+// DownloadGroup
+// --------------------------
+
+// keeps track of a set of submitted requests to wait for their completion
+class DownloadGroup
+{
+public:
+  DownloadGroup() = default;
+
+  // wraps a callback so that its call is tracked by the group
+  template <typename F> auto track(F callback)
+  {
+    this->pending++;
+
+    return [this, callback](auto &&...args)
+    {
+      callback(std::forward<decltype(args)>(args)...);
+
+      if (--this->pending == 0)
+        this->loop.quit();
+    };
+  }
+
+  // blocking, returns when all the tracked callbacks, including the ones tracked
+  // while waiting, have been called
+  void wait()
+  {
+    if (this->pending > 0)
+      this->loop.exec();
+  }
+
+private:
+  int        pending = 0;
+  QEventLoop loop;
+};
+
+} // namespace qtd
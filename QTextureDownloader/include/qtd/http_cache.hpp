@@ -0,0 +1,68 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <string>
+#include <vector>
+
+#include <QNetworkReply>
+#include <QNetworkRequest>
+
+#include "nlohmann/json.hpp"
+
+namespace qtd
+{
+
+// persistent cache of JSON responses, revalidated using ETag / Last-Modified. Bodies are
+// stored either already parsed, in binary form (CBOR), so that a '304 Not Modified' reply
+// does not require any text parsing, or as the raw JSON text received, for the responses
+// consumed by a streaming (SAX) parser. Both forms can be read back by all the loaders
+class HttpCache
+{
+public:
+  explicit HttpCache(const std::string &cache_dir_ = "");
+
+  std::string              get_cache_dir() const;
+  std::string              get_raw_tmp_path(const std::string &url) const; // raw body
+  std::vector<std::string> get_urls() const; // of the cached responses
+  bool                     is_enabled() const;
+
+  // add the conditional headers to the request if the url is already cached
+  void prepare_request(QNetworkRequest &request) const;
+
+  bool load(const std::string &url, nlohmann::json &body) const;
+  bool load_raw(const std::string &url, QByteArray &body) const; // JSON text
+  bool load_sax(const std::string                  &url,
+                nlohmann::json_sax<nlohmann::json> &handler) const;
+
+  void store(const std::string    &url,
+             const QNetworkReply  *reply,
+             const nlohmann::json &body) const;
+  void store_raw(const std::string   &url,
+                 const QNetworkReply *reply,
+                 const QByteArray    &body) const;
+
+  // same as 'store_raw', the body being already written to 'file_path', which is moved
+  // into the cache (or removed). The file is expected at 'get_raw_tmp_path', the
+  // temporary path of the entry, so that an interrupted write is overwritten next time
+  void store_raw_file(const std::string   &url,
+                      const QNetworkReply *reply,
+                      const std::string   &file_path) const;
+
+  static bool is_not_modified(const QNetworkReply *reply);
+
+private:
+  // move the body file 'tmp_path' in place, then write the metadata
+  void        commit_entry(const std::string   &url,
+                           const QNetworkReply *reply,
+                           const std::string   &tmp_path,
+                           const std::string   &ext) const;
+  std::string entry_path(const std::string &url) const; // without extension
+  void        remove_entry(const std::string &url) const;
+
+  static bool has_validators(const QNetworkReply *reply);
+
+  // --- Members
+  std::string cache_dir;
+};
+
+} // namespace qtd
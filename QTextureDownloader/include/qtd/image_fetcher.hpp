@@ -18,14 +18,13 @@ class ImageFetcher : public QObject
 public:
   explicit ImageFetcher(QObject *parent = nullptr);
 
-  QImage fetch_sync(const std::string &url, int timeout_ms = 5000);
+  // timeouts and retries follow the network policy, total timeout from the config if
+  // negative
+  QImage fetch_sync(const std::string &url, int timeout_ms = -1);
 
 signals:
   void finished(const QImage &image);
   void error_occurred(const QString &msg);
-
-private:
-  QNetworkAccessManager manager;
 };
 
 } // namespace qtd
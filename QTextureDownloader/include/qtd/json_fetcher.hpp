@@ -13,7 +13,9 @@
 
 #include <nlohmann/json.hpp>
 
+#include "qtd/http_cache.hpp"
 #include "qtd/logger.hpp"
+#include "qtd/rate_limiter.hpp"
 
 namespace qtd
 {
@@ -43,14 +45,35 @@ class JsonFetcher : public QObject
 public:
   explicit JsonFetcher(QObject *parent = nullptr);
 
-  nlohmann::json fetch_sync(const std::string &url, int timeout_ms = 5000);
+  // timeouts and retries follow the network policy, total timeout from the config if
+  // negative
+  nlohmann::json fetch_sync(const std::string &url, int timeout_ms = -1);
+
+  // streaming version, the data are fed to the SAX 'handler' as they are received (the
+  // handler is called from a worker thread) and no document is built. Only failures
+  // occurring before any data is received are retried, since the handler cannot be
+  // rewound. The mirror is tried first if enabled for metadata (see Config::mirror).
+  // Returns true if the whole document has been parsed
+  bool fetch_sax(const std::string                  &url,
+                 nlohmann::json_sax<nlohmann::json> &handler,
+                 int                                 timeout_ms = -1);
+
+  void set_cache(const HttpCache &new_cache);
 
 signals:
   void finished(const nlohmann::json &j);
   void error_occurred(const QString &msg);
 
 private:
-  QNetworkAccessManager manager;
+  // single source, 'started' is set if the handler has been fed
+  bool fetch_sax_from(const std::string                  &url,
+                      const HttpCache                    &cache,
+                      nlohmann::json_sax<nlohmann::json> &handler,
+                      int                                 timeout_ms,
+                      RateClass                           rate_class,
+                      bool                               &started);
+
+  HttpCache cache; // disabled by default
 };
 
 } // namespace qtd
\ No newline at end of file
@@ -0,0 +1,40 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <string>
+
+#include <QByteArray>
+
+namespace qtd
+{
+
+// mirror of the upstream files, either a local directory tree or a (LAN) HTTP server
+// serving the same tree. An upstream url is mapped to '<location>/<host>/<path>', with
+// '@<query>' appended if any, so that any file can be mirrored as is
+class Mirror
+{
+public:
+  explicit Mirror(const std::string &location_ = "");
+
+  // mirror defined in Config::mirror
+  static Mirror from_config();
+
+  std::string get_location() const;
+  std::string get_url(const std::string &upstream_url) const; // 'file://' if local
+  bool        is_enabled() const;
+  bool        is_local() const;
+
+  // population, local mirrors only. Existing files of the same size are kept
+  bool add_data(const std::string &upstream_url, const QByteArray &data) const;
+  bool add_file(const std::string &upstream_url, const std::string &file_path) const;
+
+  static std::string get_relative_path(const std::string &upstream_url);
+
+private:
+  std::string get_local_path(const std::string &upstream_url) const;
+
+  // --- Members
+  std::string location; // directory or base url
+};
+
+} // namespace qtd
@@ -0,0 +1,78 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <string>
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QObject>
+#include <QTimer>
+
+#include "qtd/rate_limiter.hpp"
+
+namespace qtd
+{
+
+// shared network policy: timeouts, retries and failure classification, settings are
+// defined in Config::network
+
+enum class FailureKind : int
+{
+  NONE,
+  RETRYABLE, // timeouts, connection issues, 408, 429, 5xx...
+  FATAL      // 4xx, cancellation...
+};
+
+// --------------------------
+// ReplyWatchdog
+// --------------------------
+
+// aborts a reply which gets no response ('connect' timeout), receives no data for too
+// long ('idle' timeout) or lasts for too long ('total' timeout). Owned by the reply
+class ReplyWatchdog : public QObject
+{
+  Q_OBJECT
+public:
+  // total timeout from the config if negative, none if 0
+  explicit ReplyWatchdog(QNetworkReply *reply, int total_timeout_ms = -1);
+
+  std::string get_reason() const;
+  bool        has_timed_out() const;
+
+  // stop / restart the idle timeout, when data are voluntarily not read for instance
+  void set_idle_check(bool enabled);
+
+private:
+  void on_timeout(const std::string &timeout_reason);
+
+  // --- Members
+  QNetworkReply *reply;
+  QTimer         connect_timer;
+  QTimer         idle_timer;
+  QTimer         total_timer;
+  bool           timed_out = false;
+  std::string    reason;
+};
+
+// --------------------------
+// functions
+// --------------------------
+
+FailureKind classify_failure(const QNetworkReply *reply,
+                             const ReplyWatchdog *watchdog = nullptr);
+
+// exponential backoff with jitter, 'attempt' starts at 0. A 'Retry-After' header, if
+// any, takes precedence
+int retry_delay_ms(int attempt, const QNetworkReply *reply = nullptr);
+
+// blocking GET with timeouts, retries and rate limiting. Returns the finished reply (to
+// be deleted by the caller) if successful, its data being read into 'body', nullptr
+// otherwise
+QNetworkReply *get_with_retries(QNetworkAccessManager &manager,
+                                const QNetworkRequest &request,
+                                QByteArray            &body,
+                                int                    total_timeout_ms = -1,
+                                RateClass rate_class = RateClass::FOREGROUND);
+
+} // namespace qtd
@@ -0,0 +1,41 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <string>
+
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QObject>
+#include <QPointer>
+
+namespace qtd
+{
+
+// long-lived network session shared by all the fetchers, so that connections (TCP +
+// TLS handshakes) are reused across requests, and multiplexed with HTTP/2 when the
+// server supports it
+class NetworkSession : public QObject
+{
+  Q_OBJECT
+public:
+  explicit NetworkSession(QObject *parent = nullptr);
+
+  // application-wide instance
+  static NetworkSession *get_session();
+
+  QNetworkAccessManager *get_manager();
+
+  // request with the session defaults (HTTP/2, user agent...)
+  QNetworkRequest make_request(const std::string &url) const;
+
+  // opens the connections to the hosts listed in the config ahead of the first
+  // requests, non-blocking
+  void preconnect();
+
+private:
+  QNetworkAccessManager manager;
+
+  static QPointer<NetworkSession> instance;
+};
+
+} // namespace qtd
@@ -0,0 +1,109 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+namespace qtd
+{
+
+class Texture;
+enum TextureType : int;
+
+// --------------------------
+// SaxPathHandler
+// --------------------------
+
+// base SAX handler keeping track of the location of the current value in the document,
+// as the list of the keys leading to it ("[]" for array items). Derived handlers only
+// pick up the values they need, nothing is stored otherwise
+class SaxPathHandler : public nlohmann::json_sax<nlohmann::json>
+{
+public:
+  bool null() override;
+  bool boolean(bool val) override;
+  bool number_integer(number_integer_t val) override;
+  bool number_unsigned(number_unsigned_t val) override;
+  bool number_float(number_float_t val, const string_t &s) override;
+  bool string(string_t &val) override;
+  bool binary(binary_t &val) override;
+  bool start_object(std::size_t elements) override;
+  bool key(string_t &val) override;
+  bool end_object() override;
+  bool start_array(std::size_t elements) override;
+  bool end_array() override;
+  bool parse_error(std::size_t                        position,
+                   const std::string                 &last_token,
+                   const nlohmann::detail::exception &ex) override;
+
+protected:
+  virtual void on_integer(int64_t /* val */) {}
+  virtual void on_start_object() {}
+  virtual void on_string(const std::string & /* val */) {}
+
+  std::vector<std::string> path;
+};
+
+// --------------------------
+// PolyHavenAssetListSax
+// --------------------------
+
+// asset entry, as found in the asset list ('/assets' endpoint)
+struct PolyHavenAsset
+{
+  std::string              name;
+  std::string              thumbnail_url;
+  std::string              files_hash;
+  int64_t                  date_published = 0;
+  std::vector<std::string> tags;
+};
+
+class PolyHavenAssetListSax : public SaxPathHandler
+{
+public:
+  std::map<std::string, PolyHavenAsset> assets; // by asset ID
+
+protected:
+  void on_integer(int64_t val) override;
+  void on_start_object() override;
+  void on_string(const std::string &val) override;
+};
+
+// --------------------------
+// PolyHavenFilesSax
+// --------------------------
+
+// fills the texture urls directly from the asset files document ('/files' endpoint)
+class PolyHavenFilesSax : public SaxPathHandler
+{
+public:
+  explicit PolyHavenFilesSax(Texture &texture_);
+
+  int get_count() const; // number of texture urls found
+
+protected:
+  void on_integer(int64_t val) override;
+  void on_string(const std::string &val) override;
+
+private:
+  // maps the Poly Haven map name to the texture type, false if not used
+  bool get_texture_type(TextureType &type) const;
+
+  Texture &texture;
+  int      count = 0;
+
+  // size and md5 are separate fields, gathered here by "map/res" key
+  std::map<std::string, int64_t>     sizes;
+  std::map<std::string, std::string> md5s;
+};
+
+// --------------------------
+// helpers
+// --------------------------
+
+std::string poly_haven_fingerprint(const PolyHavenAsset &asset);
+
+} // namespace qtd
@@ -0,0 +1,52 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <deque>
+#include <string>
+#include <utility>
+
+#include <QObject>
+#include <QTimer>
+
+#include "qtd/texture_manager.hpp"
+
+namespace qtd
+{
+
+// downloads the pinned materials ahead of time, so that they are already on disk when
+// requested. Materials are fetched one at a time with background priority, and only
+// once the application has been idle (no user input and no download) for a while, see
+// Config::prefetch
+class Prefetcher : public QObject
+{
+  Q_OBJECT
+public:
+  explicit Prefetcher(TextureManager *texture_manager_, QObject *parent = nullptr);
+
+  bool is_enabled() const;
+  void set_enabled(bool new_state);
+
+  // the plan is rebuilt from scratch, to be called when the pinned textures, the
+  // database or the resolution change
+  void reset();
+  void set_resolution(const TextureRes &new_res);
+
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+  void build_queue();
+  void on_idle();
+  void prefetch_next();
+
+  // --- Members
+  TextureManager *texture_manager;
+  TextureRes      res = TextureRes::R1K;
+  bool            enabled = false;
+  bool            busy = false; // a material is being retrieved
+  QTimer          idle_timer;
+
+  std::deque<std::pair<std::string, TextureRes>> queue; // (ID, resolution)
+};
+
+} // namespace qtd
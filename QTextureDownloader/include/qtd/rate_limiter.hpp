@@ -0,0 +1,106 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <array>
+#include <chrono>
+#include <functional>
+
+#include <QByteArray>
+#include <QNetworkReply>
+#include <QObject>
+#include <QPointer>
+
+namespace qtd
+{
+
+class ReplyWatchdog;
+
+// bandwidth budgets, user-initiated transfers are not slowed down by the background
+// ones (prefetch, thumbnails...) and conversely
+enum class RateClass : int
+{
+  FOREGROUND,
+  BACKGROUND,
+  UNLIMITED // local transfers (LAN mirror...)
+};
+
+// --------------------------
+// RateLimiter
+// --------------------------
+
+// token buckets shared by all the transfers, one per rate class. Rates are read from
+// Config::network on each refill, so that a change applies right away
+class RateLimiter : public QObject
+{
+  Q_OBJECT
+public:
+  explicit RateLimiter(QObject *parent = nullptr);
+
+  // application-wide instance
+  static RateLimiter *get_limiter();
+
+  // number of bytes which can be read now, up to 'wanted', 0 if the budget is exhausted
+  int64_t acquire(RateClass rate_class, int64_t wanted);
+
+  // bytes read regardless of the budget, paid back on the next acquisitions
+  void consume(RateClass rate_class, int64_t size);
+
+  int64_t get_max_rate(RateClass rate_class) const; // bytes/s, 0 if unlimited
+  int     get_wait_ms(RateClass rate_class);        // until some budget is available
+  void    set_max_rate(RateClass rate_class, int64_t bytes_per_s);
+
+private:
+  struct Bucket
+  {
+    double                                tokens = 0.0; // bytes, negative if in debt
+    std::chrono::steady_clock::time_point last_refill;
+    bool                                  started = false;
+  };
+
+  Bucket &refill(RateClass rate_class);
+
+  // --- Members
+  std::array<Bucket, 3> buckets;
+
+  static QPointer<RateLimiter> instance;
+};
+
+// --------------------------
+// ThrottledReader
+// --------------------------
+
+// reads a reply through the rate limiter. Data are left in the (bounded) reply buffer
+// until there is budget to read them, which slows down the transfer itself. Owned by the
+// reply
+class ThrottledReader : public QObject
+{
+  Q_OBJECT
+public:
+  using ChunkCallback = std::function<void(const QByteArray &chunk)>;
+
+  // data are accumulated in the reader if no callback is provided
+  ThrottledReader(QNetworkReply *reply,
+                  ReplyWatchdog *watchdog,
+                  RateClass      rate_class,
+                  ChunkCallback  on_chunk = nullptr);
+
+  QByteArray take_body();
+
+signals:
+  // the reply is finished and all its data have been read
+  void finished();
+
+private:
+  void pump();
+
+  // --- Members
+  QNetworkReply *reply;
+  ReplyWatchdog *watchdog;
+  RateClass      rate_class;
+  ChunkCallback  on_chunk;
+  QByteArray     body;
+  bool           waiting = false;
+  bool           done = false;
+};
+
+} // namespace qtd
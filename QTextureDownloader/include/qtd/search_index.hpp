@@ -0,0 +1,68 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+namespace qtd
+{
+
+class Texture;
+
+// in-memory inverted index of the textures, over the words of their name, source and
+// tags. Terms are interned (lower case), each one with the sorted list of the
+// documents containing it, and the trigrams of the terms are indexed for fuzzy
+// matching. Maintained incrementally, terms are never removed
+class SearchIndex
+{
+public:
+  SearchIndex() = default;
+
+  // (re)indexes a texture, its tags are loaded if needed
+  void add(const std::string &id, const Texture &texture);
+  void remove(const std::string &id);
+
+  bool                     contains(const std::string &id) const;
+  std::vector<std::string> get_ids() const;
+  bool                     is_dirty() const; // modified since loaded or saved
+  void                     set_is_dirty(bool new_state);
+  size_t                   size() const; // number of textures
+
+  // IDs of the textures matching all the words of 'text': a word matches the terms it
+  // is a prefix of or, if there are none, the terms sharing enough trigrams with it
+  // (typos). Views valid as long as the index is not modified
+  std::vector<std::string_view> search(const std::string &text) const;
+
+  void           json_from(nlohmann::json const &json);
+  nlohmann::json json_to() const;
+
+private:
+  void     add_document(const std::string &id, const std::vector<uint32_t> &doc_term_ids);
+  uint32_t intern(const std::string &term);
+
+  // documents matching 'word', set in 'bits' (one bit by document)
+  void match_word(const std::string &word, std::vector<uint64_t> &bits) const;
+
+  // --- Members
+  std::vector<std::string>                  doc_ids; // by document, empty if removed
+  std::unordered_map<std::string, uint32_t> docs;    // by texture ID
+  std::vector<uint32_t>                     free_docs;
+  std::vector<std::vector<uint32_t>>        doc_terms; // term IDs, by document
+
+  std::vector<std::string>                     terms;
+  std::map<std::string, uint32_t, std::less<>> term_ids; // sorted, for prefix search
+  std::vector<std::vector<uint32_t>>           postings; // sorted documents, by term
+
+  // terms, by trigram of the term padded with spaces ('  a', ' ab', 'ab ' for 'ab')
+  std::unordered_map<uint32_t, std::vector<uint32_t>> trigrams;
+
+  bool dirty = false;
+};
+
+} // namespace qtd
@@ -1,13 +1,18 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
 #pragma once
+#include <array>
 #include <memory>
 #include <string>
+#include <string_view>
 
 #include <QImage>
 
 #include "nlohmann/json.hpp"
 
+#include "qtd/poly_haven_sax.hpp"
+#include "qtd/url_templates.hpp"
+
 namespace qtd
 {
 
@@ -54,6 +59,68 @@ static std::map<TextureType, std::string> texture_type_as_string = {
     {TextureType::DISPLACEMENT, "Displacement"},
 };
 
+constexpr int TEXTURE_RES_COUNT = 4; // RUNKNOWN excluded
+constexpr int TEXTURE_TYPE_COUNT = 3;
+
+// same as the maps above, indexed by the enums
+constexpr std::array<std::string_view, TEXTURE_RES_COUNT + 1> texture_res_names = {
+    "1k",
+    "2k",
+    "4k",
+    "8k",
+    "unknown"};
+
+constexpr std::array<std::string_view, TEXTURE_TYPE_COUNT> texture_type_names = {
+    "Diffuse",
+    "Normal",
+    "Displacement"};
+
+// data by type and resolution, indexed by the enums
+template <typename T>
+using TextureTable = std::array<std::array<T, TEXTURE_RES_COUNT>, TEXTURE_TYPE_COUNT>;
+
+// --------------------------
+// TextureFileInfo
+// --------------------------
+
+// upstream metadata of a texture file, used to check the local copies
+struct TextureFileInfo
+{
+  int64_t     size = 0; // bytes, 0 if unknown
+  std::string md5;      // hex digest, empty if unknown
+};
+
+// --------------------------
+// TextureDetails
+// --------------------------
+
+// detail tier of a texture, only needed to download its files or to search its tags,
+// stored apart from the catalog and loaded on demand (see Texture::get_details)
+struct TextureDetails
+{
+  TextureDetails();
+
+  std::vector<std::string> tags;
+
+  // url template indices (see UrlTemplates), -1 for the files not available. File
+  // infos may be missing for the others
+  TextureTable<int>             url_ids;
+  TextureTable<TextureFileInfo> infos;
+
+  // full urls (previous versions) are interned in 'url_templates'
+  void           json_from(nlohmann::json const &json,
+                           UrlTemplates         &url_templates,
+                           const std::string    &id_from_source);
+  nlohmann::json json_to() const;
+};
+
+// where the details of the textures of a catalog are stored, shared by all of them
+struct TextureDetailStore
+{
+  std::string  dir; // one file per texture
+  UrlTemplates url_templates;
+};
+
 // --------------------------
 // Texture
 // --------------------------
@@ -63,26 +130,65 @@ class Texture
 public:
   Texture() = default;
 
+  // summary tier only, plus the detail tier if the JSON data contain it (catalogs of
+  // the previous versions)
   void           json_from(nlohmann::json const &json);
   nlohmann::json json_to() const;
 
-  std::string             get_id() const;
-  bool                    get_is_pinned() const;
-  std::string             get_name() const;
-  std::string             get_source() const;
+  // loaded from the store the first time it is needed
+  const TextureDetails &get_details() const;
+  bool                  is_details_loaded() const;
+  void                  release_details();
+
+  // the urls of the details already loaded are interned in the new store
+  void set_details_store(const std::shared_ptr<TextureDetailStore> &new_store);
+
+  // references valid as long as the texture is not modified (the details ones until
+  // they are released), no copy nor allocation
+  const std::string              &get_fingerprint() const;
+  const std::string              &get_id() const;
+  const std::string              &get_id_from_source() const;
+  bool                            get_is_pinned() const;
+  const std::string              &get_name() const;
+  const std::string              &get_source() const;
+  const std::vector<std::string> &get_tags() const;
+  const TextureFileInfo          &get_texture_file_info(
+      const TextureType &texture_type,
+      const TextureRes  &texture_res) const;
   std::vector<TextureRes> get_texture_resolutions(const TextureType &texture_type) const;
-  std::string             get_texture_url(const TextureType &texture_type,
-                                          const TextureRes  &texture_res) const;
-  bool                    has_texture(const TextureType &texture_type) const;
-  std::string             get_thumbnail_url() const;
+  const std::string      &get_thumbnail_url() const;
+
+  // expanded from its template (see UrlTemplates), meant to start a download
+  std::string get_texture_url(const TextureType &texture_type,
+                              const TextureRes  &texture_res) const;
+
+  bool has_texture(const TextureType &texture_type) const;
   bool has_texture(const TextureType &texture_type, const TextureRes &texture_res) const;
   void set_id(const std::string &new_id);
   void set_is_pinned(bool new_state);
+  void set_texture_file_info(const TextureType     &texture_type,
+                             const std::string     &res_key,
+                             const TextureFileInfo &info);
+  void set_texture_url(const TextureType &texture_type,
+                       const std::string &res_key,
+                       const std::string &url);
 
   bool from_poly_haven(const std::string    &asset_id,
                        const nlohmann::json &json_asset_list);
 
+  // same as above, with the asset files data already fetched
+  bool from_poly_haven(const std::string    &asset_id,
+                       const nlohmann::json &json_asset_list,
+                       const nlohmann::json &json_files);
+
+  // base data only, from an asset list parsed by PolyHavenAssetListSax, the texture
+  // urls being filled afterwards by PolyHavenFilesSax
+  void from_poly_haven(const std::string &asset_id, const PolyHavenAsset &asset);
+
 private:
+  TextureDetails     &get_details_for_edit();
+  TextureDetailStore &get_store(); // own store if not set
+
   // --- Members
   std::string id; // unique ID
 
@@ -90,12 +196,27 @@ private:
   std::string              source; // download origin
   std::string              id_from_source;
   std::string              thumbnail_url;
-  std::vector<std::string> tags;
+  std::string              fingerprint; // changes when the asset is modified upstream
   bool                     is_pinned = false;
 
-  std::map<std::string, std::string> diffuse_urls;
-  std::map<std::string, std::string> normal_urls;
-  std::map<std::string, std::string> displacement_urls;
+  // available files, what the table shows without the detail tier: one bit by type
+  // and resolution (see helper_texture_bit)
+  uint16_t available = 0;
+
+  // detail tier, null until loaded and shared by the copies of the texture (copied
+  // when modified)
+  mutable std::shared_ptr<TextureDetails> details;
+  std::shared_ptr<TextureDetailStore>     store;
 };
 
+// by texture ID, also searchable by string_view
+using TextureMap = std::map<std::string, Texture, std::less<>>;
+
+// --------------------------
+// helpers
+// --------------------------
+
+// identifies a given revision of an asset, based on its entry in the asset list
+std::string poly_haven_fingerprint(const nlohmann::json &json_asset);
+
 } // namespace qtd
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <string>
 
 #include <QComboBox>
+#include <QLineEdit>
 #include <QPushButton>
 #include <QStandardItemModel>
 #include <QTableView>
@@ -11,7 +12,10 @@
 
 #include "nlohmann/json.hpp"
 
+#include "qtd/prefetcher.hpp"
+#include "qtd/texture_filter_proxy.hpp"
 #include "qtd/texture_manager.hpp"
+#include "qtd/thumbnail_loader.hpp"
 
 namespace qtd
 {
@@ -30,11 +34,21 @@ public:
   QSize sizeHint() const override;
 
 signals:
+  // one per material as soon as its maps are retrieved ('complete' if all of them)
+  void material_retrieved(const std::string              &id,
+                          const std::vector<std::string> &texture_paths,
+                          bool                            complete);
+
+  // once all the selected materials are done
   void textures_retrieved(const std::vector<std::string> &texture_paths);
   void window_closed();
 
 public slots:
+  void choose_bandwidth_limits();
+  void choose_disk_budget();
+  void choose_mirror_location();
   void choose_storage_path();
+  void populate_mirror();
   void purge_database();
   void retrieve_selected_textures();
   void unchecked_all_items();
@@ -44,10 +58,13 @@ protected:
   void closeEvent(QCloseEvent *event) override;
 
 private:
+  // only the rows matching the search text are shown
+  void filter_table_rows();
   void setup_connections();
   void setup_layout();
   void setup_menu_bar();
   void update_table_rows();
+  void update_thumbnails(const ThumbnailBatch &batch);
 
   // --- Members
   std::string    title;
@@ -58,8 +75,17 @@ private:
   QPushButton        *button_get_selected;
   QPushButton        *button_uncheck_items;
   QComboBox          *combo_res;
+  QLineEdit          *search_edit;
   QStandardItemModel *table_model;
+  TextureFilterProxy *table_proxy;
   QTableView         *table_view;
+
+  // thumbnails are loaded asynchronously, items by texture ID
+  ThumbnailLoader                        *thumbnail_loader;
+  std::map<std::string, QStandardItem *> thumbnail_items;
+
+  // pinned materials downloaded while idle
+  Prefetcher *prefetcher;
 };
 
 } // namespace qtd
\ No newline at end of file
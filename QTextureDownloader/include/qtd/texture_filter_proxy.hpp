@@ -0,0 +1,35 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <string_view>
+#include <vector>
+
+#include <QSet>
+#include <QSortFilterProxyModel>
+
+namespace qtd
+{
+
+// sorts the table rows and keeps only the textures whose ID is among the matches of
+// the search index (see TextureManager::search_textures)
+class TextureFilterProxy : public QSortFilterProxyModel
+{
+  Q_OBJECT
+
+public:
+  explicit TextureFilterProxy(int _id_column, QObject *parent = nullptr);
+
+  // all the rows are accepted until matches are set
+  void clear_matches();
+  void set_matches(const std::vector<std::string_view> &ids);
+
+protected:
+  bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const override;
+
+private:
+  int           id_column;
+  bool          show_all = true;
+  QSet<QString> matches;
+};
+
+} // namespace qtd
@@ -1,8 +1,16 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
 #pragma once
+#include <functional>
+#include <future>
+#include <set>
+
 #include <QObject>
 
+#include "qtd/catalog_db.hpp"
+#include "qtd/content_store.hpp"
+#include "qtd/download_scheduler.hpp"
+#include "qtd/search_index.hpp"
 #include "qtd/texture.hpp"
 
 namespace qtd
@@ -26,11 +34,40 @@ struct TextureKey
 
   std::string to_string() const
   {
-    return this->id + "_" + texture_type_as_string.at(this->type) + "_" +
-           texture_res_as_string.at(this->res);
+    std::string out;
+    this->to_string(out);
+    return out;
+  }
+
+  // same as above, written to 'buffer': no allocation once it is large enough (the
+  // view is valid until the buffer is modified)
+  std::string_view to_string(std::string &buffer) const
+  {
+    std::string_view type_name = texture_type_names[this->type];
+    std::string_view res_name = texture_res_names[this->res];
+
+    buffer.clear();
+    buffer.reserve(this->id.size() + type_name.size() + res_name.size() + 2);
+    buffer.append(this->id).append("_").append(type_name).append("_").append(res_name);
+    return buffer;
   }
 };
 
+// --------------------------
+// MaterialResult
+// --------------------------
+
+// outcome of the retrieval of the maps of one material (texture ID)
+struct MaterialResult
+{
+  std::string                        id;
+  TextureRes                         res;
+  std::map<TextureType, std::string> paths;            // retrieved maps only
+  bool                               complete = false; // all the requested maps
+
+  using Callback = std::function<void(const MaterialResult &result)>;
+};
+
 // --------------------------
 // TextureManager
 // --------------------------
@@ -40,32 +77,155 @@ class TextureManager
 public:
   explicit TextureManager(const std::string &storage_path_ = "");
 
-  std::string                     get_storage_path() const;
-  std::map<std::string, Texture> &get_textures();
-  std::string                     get_texture_path(const TextureKey &texture_key) const;
-  std::string                     get_thumbnail_path(const std::string &tex_id) const;
-  bool                            is_empty() const;
-  void                            set_storage_path(const std::string &new_path);
+  std::string    get_storage_path() const;
+  const Texture *get_texture(std::string_view tex_id) const; // nullptr if unknown
+  TextureMap    &get_textures();
+  std::string    get_texture_path(const TextureKey &texture_key) const;
+  std::string    get_thumbnail_path(const std::string &tex_id) const;
+  bool           is_empty() const;
+  void           set_storage_path(const std::string &new_path);
+
+  // to be used rather than Texture::set_is_pinned, so that the change is recorded
+  void set_is_pinned(const std::string &tex_id, bool new_state);
+
+  // IDs of the textures matching the query, through the SQLite catalog if enabled
+  std::vector<std::string> query_textures(const CatalogQuery &query) const;
+
+  // IDs of the textures whose name, source or tags match all the words of 'text' (by
+  // prefix, or with typos), see SearchIndex::search
+  std::vector<std::string_view> search_textures(const std::string &text) const;
 
-  // does not override existing file (returns path to file)
+  // updates Config::storage.max_bytes and evicts files right away if needed
+  void set_disk_budget(int64_t max_bytes);
+
+  // checks a local texture file against the upstream size and MD5, without reading
+  // it: the MD5 is the one recorded when the file was downloaded
+  bool is_texture_file_valid(const TextureKey  &texture_key,
+                             const std::string &fname) const;
+
+  // does not override existing valid file (returns path to file)
   std::string try_download_texture(const TextureKey &texture_key,
-                                   bool              force_download = false) const;
+                                   bool              force_download = false);
+
+  // retrieves the maps of a material as one unit: missing maps are fetched
+  // concurrently, 'progress_callback' reports the combined progress (total is -1 as
+  // long as a size is unknown) and 'callback' is called once all the maps are done
+  void retrieve_material(const std::string              &id,
+                         const std::vector<TextureType> &types,
+                         const TextureRes               &res,
+                         MaterialResult::Callback        callback,
+                         DownloadProgressCallback        progress_callback = nullptr,
+                         bool                            force_download = false,
+                         DownloadPriority                priority =
+                             DownloadPriority::USER);
 
   void load();
-  void save() const;
 
-  void update();
-  void update_from_poly_haven();
+  // only what changed since the last save is written, see 'catalog_dirty'
+  void save();
+
+  // copies the textures, thumbnails and cached JSON documents of the storage to a local
+  // mirror directory (see Mirror), returns the number of files mirrored
+  int populate_mirror(const std::string &mirror_dir) const;
+
+  void update(bool force_full_update = false);
+
+  // only new or modified assets are fetched, unless 'full_update' is set
+  void update_from_poly_haven(bool full_update = false);
 
 private:
-  void           file_from(const std::string &fname);
-  void           file_to(const std::string &fname) const;
+  // texture downloaded to 'download_path' moved to its final location, returns its path
+  std::string    add_downloaded_texture(const TextureKey  &texture_key,
+                                        const std::string &download_path);
+  void           file_from(const std::string &fname); // JSON or CBOR (by extension)
+  std::string    get_download_path(const TextureKey &texture_key) const;
+  bool           file_to(const std::string &fname) const;
   void           json_from(nlohmann::json const &json);
   nlohmann::json json_to() const;
 
+  // disk budget (see Config::storage.max_bytes): the least recently used files of the
+  // unpinned textures are evicted to make room for 'bytes'. Returns the budget left,
+  // -1 if there is no budget
+  int64_t make_room(int64_t bytes);
+
+  // room made for a download, 'check' is filled accordingly. False if the texture
+  // cannot fit in the budget
+  bool reserve_storage(const TextureKey &texture_key, FileCheck &check);
+  void release_storage(const FileCheck &check); // once the download is done
+
+  void record_texture_file(const TextureKey &texture_key, const std::string &fname);
+
+  // records the texture files not downloaded by this version and drops the records of
+  // the files removed behind our back
+  void scan_texture_files();
+  void touch_texture_file(const TextureKey &texture_key);
+
+  // SQLite catalog brought up to date with the textures and the file records
+  void update_catalog_db();
+
+  // index of the current storage, brought up to date with the catalog
+  void load_search_index();
+
+  bool is_update_on_hold(const std::string &tex_id) const;
+  void set_update_status(const std::string &tex_id, bool success);
+
+  // detail tier of the textures, one file per texture (see TextureDetails)
+  std::string get_details_path(const std::string &tex_id) const;
+  void        save_details();
+  void        set_details_store(); // for the current storage path
+
+  // catalog changes journal (JSON lines, one change per line)
+  void append_journal(const nlohmann::json &record);
+  void check_compaction(); // outcome of the background write, if done (no wait)
+  void compact_journal();
+  int  replay_journal(const std::string &fname);
+
   // --- Members
-  std::string                    storage_path;
-  std::map<std::string, Texture> textures;
+  std::string  storage_path;
+  TextureMap   textures;      // summary tier, details loaded on demand
+  ContentStore content_store; // disabled by default
+  CatalogDb    catalog_db;    // disabled by default
+
+  // assets whose update recently failed, they are not retried before a backoff delay
+  // (growing with the number of consecutive failures)
+  struct UpdateFailure
+  {
+    int     count = 0;
+    int64_t last_attempt = 0; // seconds since epoch
+  };
+
+  std::map<std::string, UpdateFailure> update_failures;
+
+  // texture files downloaded and checked, by texture key. A file whose size or date
+  // differ from its record has been modified locally
+  struct FileRecord
+  {
+    std::string id; // texture ID
+    int64_t     size = 0;
+    int64_t     mtime = 0;
+    int64_t     last_access = 0; // seconds since epoch
+    std::string md5;             // upstream MD5 the file was checked against, if any
+  };
+
+  std::map<std::string, FileRecord, std::less<>> file_records;
+
+  int64_t reserved_bytes = 0; // downloads in progress
+
+  // persistence: what has to be written at the next save (everything as long as
+  // nothing has been loaded). Small catalog changes (pins) are not rewriting the whole
+  // catalog but appended to a journal, compacted in the background
+  bool                  catalog_dirty = true;
+  std::set<std::string> details_dirty; // texture IDs
+  bool                  failures_dirty = true;
+  bool                  records_dirty = true;
+  int                   journal_records = 0;
+  std::future<bool>     compaction; // background catalog write, if any
+
+  // where the textures load their details from, shared by all of them
+  std::shared_ptr<TextureDetailStore> details_store;
+
+  // text search, kept in sync with 'textures'
+  SearchIndex search_index;
 };
 
 } // namespace qtd
\ No newline at end of file
@@ -0,0 +1,65 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <QByteArray>
+#include <QImage>
+#include <QObject>
+#include <QSize>
+#include <QThreadPool>
+#include <QTimer>
+
+namespace qtd
+{
+
+using ThumbnailBatch = std::vector<std::pair<std::string, QImage>>; // (id, image)
+
+// thumbnail pipeline: missing files are fetched concurrently (background priority),
+// files are decoded and scaled down to Config::widget.thumbnail_size on a thread pool,
+// and the ready images are delivered in batches, so that the GUI thread only has to
+// display them
+class ThumbnailLoader : public QObject
+{
+  Q_OBJECT
+public:
+  explicit ThumbnailLoader(QObject *parent = nullptr);
+  ~ThumbnailLoader();
+
+  // drops the requests in progress, their images are never delivered
+  void cancel();
+
+  // 'url' is used to fetch the file if it does not exist yet (if not empty)
+  void request(const std::string &id,
+               const std::string &file_path,
+               const std::string &url = "");
+
+signals:
+  void thumbnails_ready(const ThumbnailBatch &batch);
+
+private:
+  // shared with the workers, replaced on cancel so that late results go nowhere
+  struct Results
+  {
+    std::mutex     mutex;
+    ThumbnailBatch images;
+    int            pending = 0; // requests not done yet
+  };
+
+  void decode(const std::shared_ptr<Results> &target,
+              const std::string              &id,
+              const std::string              &file_path,
+              const QByteArray               &data);
+  void flush();
+
+  // --- Members
+  QThreadPool              thread_pool;
+  QTimer                   flush_timer;
+  std::shared_ptr<Results> results;
+};
+
+} // namespace qtd
@@ -0,0 +1,42 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+namespace qtd
+{
+
+// interned url templates: the asset ID and the resolution are replaced by '{id}' and
+// '{res}' (braces are not valid in urls), so that the files of all the assets share a
+// handful of templates, e.g. '.../png/{res}/{id}/{id}_diff_{res}.png'. Templates are
+// only appended, an index remains valid as long as the templates are
+class UrlTemplates
+{
+public:
+  UrlTemplates() = default;
+
+  // empty if 'index' is not a known template
+  std::string expand(int index, const std::string &id, const std::string &res) const;
+
+  // index of the template of 'url', added if new
+  int intern(const std::string &url, const std::string &id, const std::string &res);
+
+  bool   is_dirty() const; // templates added since loaded or saved
+  void   set_is_dirty(bool new_state);
+  size_t size() const;
+
+  void           json_from(nlohmann::json const &json);
+  nlohmann::json json_to() const;
+
+private:
+  // --- Members
+  std::vector<std::string>             templates;
+  std::unordered_map<std::string, int> indices; // by template
+  bool                                 dirty = false;
+};
+
+} // namespace qtd
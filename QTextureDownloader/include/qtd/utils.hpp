@@ -1,12 +1,16 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
 #pragma once
+#include <functional>
 #include <string>
 
+#include <QByteArray>
 #include <QImage>
 
 #include "nlohmann/json.hpp"
 
+#include "qtd/download_scheduler.hpp"
+
 namespace qtd
 {
 
@@ -20,8 +24,22 @@ void           json_to_file(const nlohmann::json &json,
                             const std::string    &fname,
                             bool                  merge_with_existing_content = false);
 
-bool download_file(const std::string &url,
-                   const std::string &file_path,
-                   bool               overwrite = false);
+// binary (CBOR) counterparts, the file is memory-mapped for reading and atomically
+// replaced when written. Returns a discarded value on error
+nlohmann::json json_from_cbor_file(const std::string &fname);
+bool           json_to_cbor_file(const nlohmann::json &json, const std::string &fname);
+
+// blocking, the download goes through the shared DownloadScheduler. Data are streamed to
+// disk while downloading, memory usage does not depend on the file size
+bool download_file(const std::string              &url,
+                   const std::string              &file_path,
+                   bool                            overwrite = false,
+                   const DownloadProgressCallback &progress_callback = nullptr,
+                   DownloadPriority                priority = DownloadPriority::NORMAL,
+                   const FileCheck                &check = FileCheck());
+
+bool save_to_file(const QByteArray  &data,
+                  const std::string &file_path,
+                  bool               overwrite = false);
 
 } // namespace qtd
\ No newline at end of file
@@ -0,0 +1,76 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include "qtd/byte_stream.hpp"
+
+namespace qtd
+{
+
+ByteStreamBuffer::ByteStreamBuffer(size_t max_buffered_) : max_buffered(max_buffered_) {}
+
+void ByteStreamBuffer::close()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->closed = true;
+  }
+  this->cv.notify_all();
+}
+
+void ByteStreamBuffer::finish()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->finished = true;
+    this->chunks.clear();
+    this->buffered = 0;
+  }
+  this->cv.notify_all();
+}
+
+bool ByteStreamBuffer::push(const char *data, size_t size)
+{
+  {
+    // high-water mark, wait for the reader to catch up
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->cv.wait(lock,
+                  [this]()
+                  { return this->buffered < this->max_buffered || this->finished; });
+
+    if (this->finished)
+      return false;
+
+    if (size == 0)
+      return true;
+
+    this->chunks.emplace_back(data, size);
+    this->buffered += size;
+  }
+  this->cv.notify_all();
+  return true;
+}
+
+ByteStreamBuffer::int_type ByteStreamBuffer::underflow()
+{
+  if (this->gptr() < this->egptr())
+    return traits_type::to_int_type(*this->gptr());
+
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->cv.wait(lock, [this]() { return !this->chunks.empty() || this->closed; });
+
+    if (this->chunks.empty())
+      return traits_type::eof();
+
+    this->current = std::move(this->chunks.front());
+    this->chunks.pop_front();
+    this->buffered -= this->current.size();
+  }
+  this->cv.notify_all();
+
+  char *begin = this->current.data();
+  this->setg(begin, begin, begin + this->current.size());
+
+  return traits_type::to_int_type(*this->gptr());
+}
+
+} // namespace qtd
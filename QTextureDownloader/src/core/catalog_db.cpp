@@ -0,0 +1,513 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <set>
+
+#ifdef QTD_HAS_SQLITE
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#endif
+
+#include "qtd/catalog_db.hpp"
+#include "qtd/logger.hpp"
+
+namespace qtd
+{
+
+CatalogDb::CatalogDb(const std::string &db_path_) : db_path(db_path_) {}
+
+bool CatalogDb::is_open() const { return !this->connection_name.empty(); }
+
+#ifdef QTD_HAS_SQLITE
+
+// files are identified by their name (see TextureKey::to_string), type and resolution
+// being kept as their enum values for the queries
+static const std::vector<std::string> catalog_db_schema = {
+    "CREATE TABLE IF NOT EXISTS assets (id TEXT PRIMARY KEY, name TEXT, source TEXT, "
+    "id_from_source TEXT, thumbnail_url TEXT, fingerprint TEXT, "
+    "is_pinned INTEGER NOT NULL DEFAULT 0)",
+    "CREATE TABLE IF NOT EXISTS tags (asset_id TEXT NOT NULL, tag TEXT NOT NULL, "
+    "PRIMARY KEY (asset_id, tag)) WITHOUT ROWID",
+    "CREATE TABLE IF NOT EXISTS files (name TEXT PRIMARY KEY, asset_id TEXT NOT NULL, "
+    "type INTEGER NOT NULL, res INTEGER NOT NULL, url TEXT, size INTEGER, md5 TEXT, "
+    "path TEXT, downloaded INTEGER NOT NULL DEFAULT 0)",
+    "CREATE INDEX IF NOT EXISTS assets_source ON assets (source)",
+    "CREATE INDEX IF NOT EXISTS assets_pinned ON assets (is_pinned)",
+    "CREATE INDEX IF NOT EXISTS tags_tag ON tags (tag, asset_id)",
+    "CREATE INDEX IF NOT EXISTS files_asset ON files (asset_id)",
+    "CREATE INDEX IF NOT EXISTS files_type_res ON files (type, res, downloaded, "
+    "asset_id)"};
+
+bool helper_exec(QSqlQuery &query, const std::string &context)
+{
+  if (query.exec())
+    return true;
+
+  Logger::log()->error("CatalogDb::{}: {}",
+                       context,
+                       query.lastError().text().toStdString());
+  return false;
+}
+
+bool helper_exec(QSqlQuery &query, const std::string &context, const std::string &sql)
+{
+  return query.prepare(QString::fromStdString(sql)) && helper_exec(query, context);
+}
+
+int CatalogDb::count() const
+{
+  if (!this->is_open())
+    return -1;
+
+  QSqlQuery query(QSqlDatabase::database(this->connection_name.c_str()));
+
+  if (!helper_exec(query, "count", "SELECT COUNT(*) FROM assets") || !query.next())
+    return -1;
+
+  return query.value(0).toInt();
+}
+
+bool CatalogDb::get_texture(const std::string &id, Texture &texture) const
+{
+  if (!this->is_open())
+    return false;
+
+  QSqlDatabase db = QSqlDatabase::database(this->connection_name.c_str());
+  QSqlQuery    query(db);
+
+  query.prepare("SELECT name, source, id_from_source, thumbnail_url, fingerprint, "
+                "is_pinned FROM assets WHERE id = ?");
+  query.addBindValue(QString::fromStdString(id));
+
+  if (!helper_exec(query, "get_texture") || !query.next())
+    return false;
+
+  // same layout as Texture::json_to
+  nlohmann::json json = {{"id", id},
+                         {"name", query.value(0).toString().toStdString()},
+                         {"source", query.value(1).toString().toStdString()},
+                         {"id_from_source", query.value(2).toString().toStdString()},
+                         {"thumbnail_url", query.value(3).toString().toStdString()},
+                         {"fingerprint", query.value(4).toString().toStdString()},
+                         {"is_pinned", query.value(5).toBool()},
+                         {"tags", nlohmann::json::array()}};
+
+  query.prepare("SELECT tag FROM tags WHERE asset_id = ?");
+  query.addBindValue(QString::fromStdString(id));
+
+  if (!helper_exec(query, "get_texture"))
+    return false;
+
+  while (query.next())
+    json["tags"].push_back(query.value(0).toString().toStdString());
+
+  query.prepare("SELECT type, res, url, size, md5 FROM files WHERE asset_id = ?");
+  query.addBindValue(QString::fromStdString(id));
+
+  if (!helper_exec(query, "get_texture"))
+    return false;
+
+  texture.json_from(json);
+
+  while (query.next())
+  {
+    TextureType type = TextureType(query.value(0).toInt());
+    std::string res_key = texture_res_as_string.at(TextureRes(query.value(1).toInt()));
+
+    texture.set_texture_url(type, res_key, query.value(2).toString().toStdString());
+    texture.set_texture_file_info(
+        type,
+        res_key,
+        TextureFileInfo{query.value(3).toLongLong(),
+                        query.value(4).toString().toStdString()});
+  }
+
+  return true;
+}
+
+bool CatalogDb::import_textures(TextureMap &textures)
+{
+  if (!this->is_open())
+    return false;
+
+  QSqlDatabase db = QSqlDatabase::database(this->connection_name.c_str());
+  QSqlQuery    query(db);
+
+  // current state, to only write what changed
+  std::map<std::string, std::pair<std::string, bool>> existing; // fingerprint, pinned
+
+  if (!helper_exec(query,
+                   "import_textures",
+                   "SELECT id, fingerprint, is_pinned FROM assets"))
+    return false;
+
+  while (query.next())
+    existing[query.value(0).toString().toStdString()] = {
+        query.value(1).toString().toStdString(),
+        query.value(2).toBool()};
+
+  if (!db.transaction())
+  {
+    Logger::log()->error("CatalogDb::import_textures: {}",
+                         db.lastError().text().toStdString());
+    return false;
+  }
+
+  bool ok = true;
+  int  n_updated = 0;
+
+  // removed assets
+  for (auto &[id, _] : existing)
+  {
+    if (textures.contains(id))
+      continue;
+
+    for (auto sql : {"DELETE FROM assets WHERE id = ?",
+                     "DELETE FROM tags WHERE asset_id = ?",
+                     "DELETE FROM files WHERE asset_id = ?"})
+    {
+      query.prepare(sql);
+      query.addBindValue(QString::fromStdString(id));
+      ok = ok && helper_exec(query, "import_textures");
+    }
+  }
+
+  // new or modified assets
+  for (auto &[id, tex] : textures)
+  {
+    auto it = existing.find(id);
+
+    if (it != existing.end() && it->second.first == tex.get_fingerprint() &&
+        it->second.second == tex.get_is_pinned())
+      continue;
+
+    // details tier only loaded for the import
+    bool details_loaded = tex.is_details_loaded();
+
+    query.prepare("INSERT INTO assets (id, name, source, id_from_source, thumbnail_url, "
+                  "fingerprint, is_pinned) VALUES (?, ?, ?, ?, ?, ?, ?) ON CONFLICT(id) "
+                  "DO UPDATE SET name = excluded.name, source = excluded.source, "
+                  "id_from_source = excluded.id_from_source, thumbnail_url = "
+                  "excluded.thumbnail_url, fingerprint = excluded.fingerprint, "
+                  "is_pinned = excluded.is_pinned");
+    query.addBindValue(QString::fromStdString(id));
+    query.addBindValue(QString::fromStdString(tex.get_name()));
+    query.addBindValue(QString::fromStdString(tex.get_source()));
+    query.addBindValue(QString::fromStdString(tex.get_id_from_source()));
+    query.addBindValue(QString::fromStdString(tex.get_thumbnail_url()));
+    query.addBindValue(QString::fromStdString(tex.get_fingerprint()));
+    query.addBindValue(tex.get_is_pinned());
+    ok = ok && helper_exec(query, "import_textures");
+
+    query.prepare("DELETE FROM tags WHERE asset_id = ?");
+    query.addBindValue(QString::fromStdString(id));
+    ok = ok && helper_exec(query, "import_textures");
+
+    const std::vector<std::string> &tags = tex.get_tags();
+
+    for (auto &tag : std::set<std::string>(tags.begin(), tags.end()))
+    {
+      query.prepare("INSERT INTO tags (asset_id, tag) VALUES (?, ?)");
+      query.addBindValue(QString::fromStdString(id));
+      query.addBindValue(QString::fromStdString(tag));
+      ok = ok && helper_exec(query, "import_textures");
+    }
+
+    // the download state of the files is kept
+    std::vector<std::string> names;
+
+    for (auto &type : all_texture_types)
+      for (auto &res : tex.get_texture_resolutions(type))
+      {
+        const TextureFileInfo &info = tex.get_texture_file_info(type, res);
+
+        // same as TextureKey::to_string
+        names.push_back(id + "_" + texture_type_as_string.at(type) + "_" +
+                        texture_res_as_string.at(res));
+
+        query.prepare("INSERT INTO files (name, asset_id, type, res, url, size, md5) "
+                      "VALUES (?, ?, ?, ?, ?, ?, ?) ON CONFLICT(name) DO UPDATE SET "
+                      "url = excluded.url, size = excluded.size, md5 = excluded.md5");
+        query.addBindValue(QString::fromStdString(names.back()));
+        query.addBindValue(QString::fromStdString(id));
+        query.addBindValue(int(type));
+        query.addBindValue(int(res));
+        query.addBindValue(QString::fromStdString(tex.get_texture_url(type, res)));
+        query.addBindValue(qint64(info.size));
+        query.addBindValue(QString::fromStdString(info.md5));
+        ok = ok && helper_exec(query, "import_textures");
+      }
+
+    // files the asset does not offer anymore
+    std::string sql = "DELETE FROM files WHERE asset_id = ?";
+
+    if (!names.empty())
+    {
+      sql += " AND name NOT IN (?";
+      for (size_t k = 1; k < names.size(); k++)
+        sql += ", ?";
+      sql += ")";
+    }
+
+    query.prepare(QString::fromStdString(sql));
+    query.addBindValue(QString::fromStdString(id));
+
+    for (auto &name : names)
+      query.addBindValue(QString::fromStdString(name));
+
+    ok = ok && helper_exec(query, "import_textures");
+
+    if (!details_loaded)
+      tex.release_details();
+
+    n_updated++;
+  }
+
+  if (!ok || !db.commit())
+  {
+    db.rollback();
+    Logger::log()->error("CatalogDb::import_textures: import failed, rolled back");
+    return false;
+  }
+
+  Logger::log()->trace("CatalogDb::import_textures: {} asset(s) updated", n_updated);
+  return true;
+}
+
+bool CatalogDb::import_file_states(const std::map<std::string, std::string> &paths)
+{
+  if (!this->is_open())
+    return false;
+
+  QSqlDatabase db = QSqlDatabase::database(this->connection_name.c_str());
+  QSqlQuery    query(db);
+
+  // current state, path by file name
+  std::map<std::string, std::string> existing;
+
+  if (!helper_exec(query,
+                   "import_file_states",
+                   "SELECT name, path FROM files WHERE downloaded = 1"))
+    return false;
+
+  while (query.next())
+    existing[query.value(0).toString().toStdString()] =
+        query.value(1).toString().toStdString();
+
+  if (!db.transaction())
+  {
+    Logger::log()->error("CatalogDb::import_file_states: {}",
+                         db.lastError().text().toStdString());
+    return false;
+  }
+
+  bool ok = true;
+  int  n_updated = 0;
+
+  auto set_state = [&query, &ok, &n_updated](const std::string &name,
+                                              const std::string &path,
+                                              bool               downloaded)
+  {
+    query.prepare("UPDATE files SET path = ?, downloaded = ? WHERE name = ?");
+    query.addBindValue(QString::fromStdString(path));
+    query.addBindValue(downloaded);
+    query.addBindValue(QString::fromStdString(name));
+    ok = ok && helper_exec(query, "import_file_states");
+    n_updated++;
+  };
+
+  for (auto &[name, path] : existing)
+    if (!paths.contains(name))
+      set_state(name, "", false);
+
+  for (auto &[name, path] : paths)
+  {
+    auto it = existing.find(name);
+
+    if (it == existing.end() || it->second != path)
+      set_state(name, path, true);
+  }
+
+  if (!ok || !db.commit())
+  {
+    db.rollback();
+    Logger::log()->error("CatalogDb::import_file_states: import failed, rolled back");
+    return false;
+  }
+
+  Logger::log()->trace("CatalogDb::import_file_states: {} file(s) updated", n_updated);
+  return true;
+}
+
+bool CatalogDb::is_available() { return true; }
+
+bool CatalogDb::open()
+{
+  if (this->is_open())
+    return true;
+
+  if (this->db_path.empty())
+    return false;
+
+  // one connection per database file
+  std::string  name = "qtd_catalog_" + this->db_path;
+  QSqlDatabase db = QSqlDatabase::contains(name.c_str())
+                        ? QSqlDatabase::database(name.c_str())
+                        : QSqlDatabase::addDatabase("QSQLITE", name.c_str());
+
+  db.setDatabaseName(QString::fromStdString(this->db_path));
+
+  if (!db.open())
+  {
+    Logger::log()->error("CatalogDb::open: could not open {}: {}",
+                         this->db_path,
+                         db.lastError().text().toStdString());
+    return false;
+  }
+
+  QSqlQuery query(db);
+
+  // readers are not blocked by the writes
+  helper_exec(query, "open", "PRAGMA journal_mode = WAL");
+  helper_exec(query, "open", "PRAGMA synchronous = NORMAL");
+
+  for (auto &sql : catalog_db_schema)
+    if (!helper_exec(query, "open", sql))
+      return false;
+
+  this->connection_name = name;
+  return true;
+}
+
+std::vector<std::string> CatalogDb::query(const CatalogQuery &query) const
+{
+  std::vector<std::string> ids;
+
+  if (!this->is_open())
+    return ids;
+
+  // the filters are all served by an index
+  std::string           sql = "SELECT a.id FROM assets a WHERE 1";
+  std::vector<QVariant> values;
+
+  if (!query.source.empty())
+  {
+    sql += " AND a.source = ?";
+    values.push_back(QString::fromStdString(query.source));
+  }
+
+  if (query.is_pinned >= 0)
+  {
+    sql += " AND a.is_pinned = ?";
+    values.push_back(query.is_pinned);
+  }
+
+  if (!query.tag.empty())
+  {
+    sql += " AND EXISTS (SELECT 1 FROM tags t WHERE t.tag = ? AND t.asset_id = a.id)";
+    values.push_back(QString::fromStdString(query.tag));
+  }
+
+  for (auto &type : query.types)
+  {
+    sql += " AND EXISTS (SELECT 1 FROM files f WHERE f.type = ?";
+    values.push_back(int(type));
+
+    if (query.res != TextureRes::RUNKNOWN)
+    {
+      sql += " AND f.res = ?";
+      values.push_back(int(query.res));
+    }
+
+    if (query.downloaded)
+      sql += " AND f.downloaded = 1";
+
+    sql += " AND f.asset_id = a.id)";
+  }
+
+  sql += " ORDER BY a.id";
+
+  QSqlQuery sql_query(QSqlDatabase::database(this->connection_name.c_str()));
+  sql_query.setForwardOnly(true);
+  sql_query.prepare(QString::fromStdString(sql));
+
+  for (auto &v : values)
+    sql_query.addBindValue(v);
+
+  if (!helper_exec(sql_query, "query"))
+    return ids;
+
+  while (sql_query.next())
+    ids.push_back(sql_query.value(0).toString().toStdString());
+
+  return ids;
+}
+
+bool CatalogDb::set_file_state(const std::string &name,
+                               const std::string &path,
+                               bool               downloaded)
+{
+  if (!this->is_open())
+    return false;
+
+  QSqlQuery query(QSqlDatabase::database(this->connection_name.c_str()));
+
+  query.prepare("UPDATE files SET path = ?, downloaded = ? WHERE name = ?");
+  query.addBindValue(QString::fromStdString(path));
+  query.addBindValue(downloaded);
+  query.addBindValue(QString::fromStdString(name));
+
+  return helper_exec(query, "set_file_state");
+}
+
+bool CatalogDb::set_pinned(const std::string &id, bool new_state)
+{
+  if (!this->is_open())
+    return false;
+
+  QSqlQuery query(QSqlDatabase::database(this->connection_name.c_str()));
+
+  query.prepare("UPDATE assets SET is_pinned = ? WHERE id = ?");
+  query.addBindValue(new_state);
+  query.addBindValue(QString::fromStdString(id));
+
+  return helper_exec(query, "set_pinned");
+}
+
+#else
+
+// built without SQLite
+
+int CatalogDb::count() const { return -1; }
+
+bool CatalogDb::get_texture(const std::string &, Texture &) const { return false; }
+
+bool CatalogDb::import_textures(TextureMap &) { return false; }
+
+bool CatalogDb::import_file_states(const std::map<std::string, std::string> &)
+{
+  return false;
+}
+
+bool CatalogDb::is_available() { return false; }
+
+bool CatalogDb::open()
+{
+  Logger::log()->error(
+      "CatalogDb::open: built without SQLite support (see QTD_ENABLE_SQLITE)");
+  return false;
+}
+
+std::vector<std::string> CatalogDb::query(const CatalogQuery &) const { return {}; }
+
+bool CatalogDb::set_file_state(const std::string &, const std::string &, bool)
+{
+  return false;
+}
+
+bool CatalogDb::set_pinned(const std::string &, bool) { return false; }
+
+#endif
+
+} // namespace qtd
@@ -0,0 +1,244 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <filesystem>
+
+#ifdef QTD_OS_LINUX
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+#include <QCryptographicHash>
+#include <QFile>
+
+#include "qtd/content_store.hpp"
+#include "qtd/logger.hpp"
+#include "qtd/utils.hpp"
+
+namespace qtd
+{
+
+// copy-on-write clone of the file data, only on filesystems supporting it (Btrfs, XFS...)
+bool helper_reflink([[maybe_unused]] const std::string &src,
+                    [[maybe_unused]] const std::string &dst)
+{
+#ifdef QTD_OS_LINUX
+  int fd_src = ::open(src.c_str(), O_RDONLY);
+  if (fd_src < 0)
+    return false;
+
+  int fd_dst = ::open(dst.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd_dst < 0)
+  {
+    ::close(fd_src);
+    return false;
+  }
+
+  bool ok = ::ioctl(fd_dst, FICLONE, fd_src) == 0;
+
+  ::close(fd_src);
+  ::close(fd_dst);
+
+  if (!ok)
+    std::filesystem::remove(dst);
+
+  return ok;
+#else
+  return false;
+#endif
+}
+
+std::string helper_sha256(const std::string &file_path)
+{
+  QFile file(QString::fromStdString(file_path));
+  if (!file.open(QIODevice::ReadOnly))
+    return "";
+
+  QCryptographicHash hash(QCryptographicHash::Sha256);
+  if (!hash.addData(&file))
+    return "";
+
+  return hash.result().toHex().toStdString();
+}
+
+ContentStore::ContentStore(const std::string &root_path_) : root_path(root_path_) {}
+
+bool ContentStore::contains(std::string_view name) const
+{
+  return this->index.contains(name);
+}
+
+std::string ContentStore::get_path(std::string_view name) const
+{
+  auto it = this->index.find(name);
+  return it == this->index.end() ? "" : this->root_path + "/" + it->second;
+}
+
+std::string ContentStore::ingest(const std::string &name,
+                                 const std::string &file_path,
+                                 bool               keep_source)
+{
+  if (!this->is_enabled())
+    return "";
+
+  std::string hash = helper_sha256(file_path);
+
+  if (hash.empty())
+  {
+    Logger::log()->error("ContentStore::ingest: could not read {}", file_path);
+    return "";
+  }
+
+  std::string extension = std::filesystem::path(file_path).extension().string();
+  std::string rel_path = this->object_path(hash, extension);
+  std::string obj_path = this->root_path + "/" + rel_path;
+
+  std::error_code ec;
+
+  if (std::filesystem::exists(obj_path))
+  {
+    // already stored, deduplicated
+    Logger::log()->trace("ContentStore::ingest: {} already stored as {}", name, hash);
+
+    if (!keep_source)
+      std::filesystem::remove(file_path, ec);
+  }
+  else
+  {
+    std::filesystem::create_directories(std::filesystem::path(obj_path).parent_path(),
+                                        ec);
+
+    if (!keep_source)
+      std::filesystem::rename(file_path, obj_path, ec);
+    else
+    {
+      std::filesystem::create_hard_link(file_path, obj_path, ec);
+
+      if (ec && helper_reflink(file_path, obj_path))
+        ec.clear();
+
+      if (ec)
+      {
+        ec.clear();
+        std::filesystem::copy_file(file_path, obj_path, ec);
+      }
+    }
+
+    if (ec)
+    {
+      Logger::log()->error("ContentStore::ingest: could not store {}: {}",
+                           file_path,
+                           ec.message());
+      return "";
+    }
+  }
+
+  // previous content of the name (downloaded again), deleted unless still in use
+  auto it = this->index.find(name);
+
+  if (it != this->index.end() && it->second != rel_path)
+    this->remove(name);
+
+  this->index[name] = rel_path;
+  return obj_path;
+}
+
+int ContentStore::import_directory(
+    const std::string                              &dir_path,
+    const std::string                              &extension,
+    const std::function<bool(const std::string &)> &filter,
+    bool                                            keep_source)
+{
+  if (!this->is_enabled() || !std::filesystem::is_directory(dir_path))
+    return 0;
+
+  std::vector<std::filesystem::path> candidates;
+
+  for (auto &entry : std::filesystem::directory_iterator(dir_path))
+  {
+    std::string name = entry.path().stem().string();
+
+    if (entry.is_regular_file() && entry.path().extension() == extension &&
+        !this->contains(name) && (!filter || filter(name)))
+      candidates.push_back(entry.path());
+  }
+
+  int count = 0;
+
+  for (auto &path : candidates)
+    if (!this->ingest(path.stem().string(), path.string(), keep_source).empty())
+      count++;
+
+  if (count)
+    Logger::log()->info("ContentStore::import_directory: {} file(s) imported from {}",
+                        count,
+                        dir_path);
+
+  return count;
+}
+
+bool ContentStore::is_enabled() const { return !this->root_path.empty(); }
+
+void ContentStore::load()
+{
+  this->index.clear();
+
+  std::string fname = this->root_path + "/objects/index.json";
+
+  if (!this->is_enabled() || !std::filesystem::exists(fname))
+    return;
+
+  nlohmann::json json = json_from_file(fname);
+
+  for (auto &[name, rel_path] : json.items())
+    if (std::filesystem::exists(this->root_path + "/" + rel_path.get<std::string>()))
+      this->index[name] = rel_path.get<std::string>();
+}
+
+int64_t ContentStore::remove(const std::string &name)
+{
+  auto it = this->index.find(name);
+  if (it == this->index.end())
+    return 0;
+
+  std::string rel_path = it->second;
+  this->index.erase(it);
+
+  // deduplicated content still in use
+  for (auto &[other_name, other_path] : this->index)
+    if (other_path == rel_path)
+      return 0;
+
+  std::error_code ec;
+  std::string     obj_path = this->root_path + "/" + rel_path;
+  int64_t         size = int64_t(std::filesystem::file_size(obj_path, ec));
+
+  if (ec || !std::filesystem::remove(obj_path, ec))
+  {
+    Logger::log()->error("ContentStore::remove: could not remove {}", obj_path);
+    return 0;
+  }
+
+  return size;
+}
+
+std::string ContentStore::object_path(const std::string &hash,
+                                      const std::string &extension) const
+{
+  // two-level fan-out to keep directories small
+  return "objects/" + hash.substr(0, 2) + "/" + hash + extension;
+}
+
+void ContentStore::save() const
+{
+  if (!this->is_enabled())
+    return;
+
+  std::error_code ec;
+  std::filesystem::create_directories(this->root_path + "/objects", ec);
+
+  json_to_file(nlohmann::json(this->index), this->root_path + "/objects/index.json");
+}
+
+} // namespace qtd
@@ -1,55 +1,78 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
 #include <QEventLoop>
-#include <QFile>
 #include <QFileInfo>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
-#include <QNetworkRequest>
-#include <QObject>
-#include <QUrl>
+#include <QSaveFile>
 
+#include "qtd/download_scheduler.hpp"
 #include "qtd/logger.hpp"
+#include "qtd/utils.hpp"
 
 namespace qtd
 {
 
-bool download_file(const std::string &url, const std::string &file_path, bool overwrite)
+bool download_file(const std::string              &url,
+                   const std::string              &file_path,
+                   bool                            overwrite,
+                   const DownloadProgressCallback &progress_callback,
+                   DownloadPriority                priority,
+                   const FileCheck                &check)
 {
-  QNetworkAccessManager manager;
-  QNetworkRequest       request(QUrl(QString::fromStdString(url)));
-  QNetworkReply        *reply = manager.get(request);
+  QFileInfo file_info(QString::fromStdString(file_path));
+  if (file_info.exists() && !overwrite)
+  {
+    Logger::log()->trace("download_file: file already exists, skipping: {}", file_path);
+    return false;
+  }
 
+  bool       ok = false;
   QEventLoop loop;
-  QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+
+  DownloadScheduler::get_scheduler()->submit_file(
+      url,
+      file_path,
+      priority,
+      [&ok, &loop](bool success)
+      {
+        ok = success;
+        loop.quit();
+      },
+      progress_callback,
+      check);
+
   loop.exec(); // wait until finished
 
-  if (reply->error() != QNetworkReply::NoError)
-  {
+  if (!ok)
     Logger::log()->error("download_file: download error: {}", url);
-    reply->deleteLater();
-    return false;
-  }
 
+  return ok;
+}
+
+bool save_to_file(const QByteArray &data, const std::string &file_path, bool overwrite)
+{
   QFileInfo file_info(QString::fromStdString(file_path));
   if (file_info.exists() && !overwrite)
   {
-    Logger::log()->trace("download_file: file already exists, skipping: {}", file_path);
-    reply->deleteLater();
+    Logger::log()->trace("save_to_file: file already exists, skipping: {}", file_path);
     return false;
   }
 
-  QFile file(QString::fromStdString(file_path));
+  // temporary file + rename, no partially written file
+  QSaveFile file(QString::fromStdString(file_path));
   if (!file.open(QIODevice::WriteOnly))
   {
-    Logger::log()->error("download_file: error writing file: {}", file_path);
-    reply->deleteLater();
+    Logger::log()->error("save_to_file: error writing file: {}", file_path);
+    return false;
+  }
+
+  file.write(data);
+
+  if (!file.commit())
+  {
+    Logger::log()->error("save_to_file: error writing file: {}", file_path);
     return false;
   }
 
-  file.write(reply->readAll());
-  file.close();
-  reply->deleteLater();
   return true;
 }
 
@@ -0,0 +1,672 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QNetworkRequest>
+#include <QTimer>
+#include <QUrl>
+
+#include "qtd/config.hpp"
+#include "qtd/download_scheduler.hpp"
+#include "qtd/logger.hpp"
+#include "qtd/mirror.hpp"
+#include "qtd/network_policy.hpp"
+#include "qtd/network_session.hpp"
+#include "qtd/rate_limiter.hpp"
+
+namespace qtd
+{
+
+std::string helper_get_host(const std::string &url)
+{
+  return QUrl(QString::fromStdString(url)).host().toStdString();
+}
+
+// --------------------------
+// PartFile
+// --------------------------
+
+// data are written to a temporary '.part' file, renamed once complete. An existing
+// '.part' file is the result of an interrupted download, which is resumed. The data are
+// hashed as they are written, so that the file is checked without being read again.
+// The validator of the file (ETag or Last-Modified) is kept next to it, so that the
+// resume is conditional (If-Range) and restarts from scratch if the file changed
+struct DownloadScheduler::PartFile
+{
+  std::string        file_path;
+  std::string        part_path;
+  std::string        validator_path;
+  FileCheck          check;
+  QFile              file;
+  QCryptographicHash hash;
+  QByteArray         validator; // of the data already received
+  int64_t            offset = 0; // resumed from
+  int64_t            size = 0;
+  bool               status_checked = false;
+  bool               write_error = false;
+  bool               range_error = false;
+  bool               check_error = false;
+  bool               quota_error = false;
+
+  explicit PartFile(const std::string &file_path_, const FileCheck &check_)
+      : file_path(file_path_), part_path(file_path_ + ".part"),
+        validator_path(part_path + ".validator"), check(check_),
+        file(QString::fromStdString(part_path)), hash(QCryptographicHash::Md5)
+  {
+  }
+
+  bool open()
+  {
+    if (!this->file.open(QIODevice::ReadWrite | QIODevice::Append))
+    {
+      Logger::log()->error("DownloadScheduler: error writing file: {}", this->part_path);
+      return false;
+    }
+
+    this->offset = this->file.size();
+    this->size = this->offset;
+
+    // without a validator, there is no telling whether the file changed since
+    std::string   line;
+    std::ifstream validator_file(this->validator_path);
+
+    if (this->offset > 0 && std::getline(validator_file, line) && !line.empty())
+      this->validator = QByteArray::fromStdString(line);
+    else
+      this->restart();
+
+    // the hash of a resumed download starts with the data already received, read once
+    if (this->offset > 0 && !this->check.md5.empty())
+    {
+      this->file.seek(0);
+      if (!this->hash.addData(&this->file))
+      {
+        // unreadable partial file, start over
+        this->restart();
+      }
+    }
+
+    return true;
+  }
+
+  // partial file and its validator removed
+  void remove()
+  {
+    this->file.remove();
+
+    std::error_code ec;
+    std::filesystem::remove(this->validator_path, ec);
+  }
+
+  void restart()
+  {
+    this->file.resize(0);
+    this->offset = 0;
+    this->size = 0;
+    this->hash.reset();
+    this->validator.clear();
+  }
+
+  // validator of the data about to be received, a weak ETag cannot be used for a
+  // range request
+  void store_validator(QNetworkReply *reply)
+  {
+    QByteArray etag = reply->rawHeader("ETag");
+
+    this->validator = !etag.isEmpty() && !etag.startsWith("W/")
+                          ? etag
+                          : reply->rawHeader("Last-Modified");
+
+    std::error_code ec;
+    std::filesystem::remove(this->validator_path, ec);
+
+    if (!this->validator.isEmpty())
+    {
+      std::ofstream validator_file(this->validator_path);
+      validator_file << this->validator.toStdString() << "\n";
+    }
+  }
+
+  void write(QNetworkReply *reply, const QByteArray &chunk)
+  {
+    if (!this->status_checked)
+    {
+      this->status_checked = true;
+      int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+      if (this->offset > 0 && status == 416)
+      {
+        // range not satisfiable, the partial file cannot be trusted
+        this->range_error = true;
+        reply->abort();
+        return;
+      }
+      else if (status >= 400)
+      {
+        // error page, not to be mixed with the file data
+        reply->abort();
+        return;
+      }
+      else if (this->offset > 0 && status != 206)
+      {
+        // range ignored by the server or file changed (If-Range), the whole file is
+        // sent again
+        this->restart();
+      }
+
+      if (this->offset == 0)
+        this->store_validator(reply);
+
+      // nothing written yet, refused before taking any disk space
+      int64_t length = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+
+      if (this->check.max_size > 0 && this->offset + length > this->check.max_size)
+      {
+        Logger::log()->error(
+            "DownloadScheduler: not enough disk budget for {} ({} bytes announced)",
+            this->file_path,
+            this->offset + length);
+        this->quota_error = true;
+        reply->abort();
+        return;
+      }
+    }
+
+    if (reply->error() != QNetworkReply::NoError || this->write_error ||
+        this->check_error || this->quota_error)
+      return;
+
+    if (this->file.write(chunk) != chunk.size())
+    {
+      this->write_error = true;
+      reply->abort();
+      return;
+    }
+
+    this->size += chunk.size();
+    this->hash.addData(chunk);
+
+    // no need to wait for the end of the transfer to know the file is wrong
+    if (this->check.size > 0 && this->size > this->check.size)
+    {
+      this->check_error = true;
+      reply->abort();
+    }
+    else if (this->check.max_size > 0 && this->size > this->check.max_size)
+    {
+      this->quota_error = true;
+      reply->abort();
+    }
+  }
+
+  bool verify()
+  {
+    if (this->check.size > 0 && this->size != this->check.size)
+    {
+      Logger::log()->error("DownloadScheduler: size mismatch for {}: {} instead of {}",
+                           this->file_path,
+                           this->size,
+                           this->check.size);
+      return false;
+    }
+
+    if (!this->check.md5.empty())
+    {
+      std::string md5 = this->hash.result().toHex().toStdString();
+
+      if (md5 != this->check.md5)
+      {
+        Logger::log()->error("DownloadScheduler: MD5 mismatch for {}: {} instead of {}",
+                             this->file_path,
+                             md5,
+                             this->check.md5);
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool finish(bool transfer_ok)
+  {
+    this->file.close();
+
+    // a complete but corrupted file cannot be resumed from
+    if (transfer_ok && !this->check_error && !this->verify())
+      this->check_error = true;
+
+    if (this->write_error || this->range_error || this->check_error ||
+        this->quota_error)
+    {
+      Logger::log()->error(
+          "DownloadScheduler: error writing file or invalid partial file: {}",
+          this->part_path);
+      this->remove();
+      return false;
+    }
+
+    // the partial file is kept for a later resume
+    if (!transfer_ok)
+      return false;
+
+    // atomic replacement
+    std::error_code ec;
+    std::filesystem::rename(this->part_path, this->file_path, ec);
+
+    if (ec)
+    {
+      Logger::log()->error("DownloadScheduler: could not rename {}: {}",
+                           this->part_path,
+                           ec.message());
+      return false;
+    }
+
+    std::filesystem::remove(this->validator_path, ec);
+    return true;
+  }
+};
+
+// --------------------------
+// DownloadScheduler
+// --------------------------
+
+QPointer<DownloadScheduler> DownloadScheduler::instance = nullptr;
+
+DownloadScheduler::DownloadScheduler(QObject *parent) : QObject(parent) {}
+
+DownloadScheduler *DownloadScheduler::get_scheduler()
+{
+  // owned by the application, deleted along with it
+  if (!instance)
+    instance = new DownloadScheduler(QCoreApplication::instance());
+  return instance;
+}
+
+void DownloadScheduler::finish_job(const std::shared_ptr<Job> &job,
+                                   bool                        ok,
+                                   const QByteArray           &data,
+                                   const nlohmann::json       &json)
+{
+  // new identical requests made by the callbacks are not coalesced with this one
+  this->jobs.erase(job->key);
+
+  // refill first, so that the network is kept busy while the callbacks run
+  this->start_pending();
+
+  for (auto &callback : job->callbacks)
+    callback(ok, data, json);
+
+  if (this->is_idle())
+    Q_EMIT this->idle();
+}
+
+bool DownloadScheduler::is_idle() const { return this->jobs.empty(); }
+
+void DownloadScheduler::on_reply_finished(const std::shared_ptr<Job>      &job,
+                                          QNetworkReply                   *reply,
+                                          const ReplyWatchdog             *watchdog,
+                                          ThrottledReader                 *reader,
+                                          const std::shared_ptr<PartFile> &part)
+{
+  FailureKind    failure = classify_failure(reply, watchdog);
+  bool           ok = failure == FailureKind::NONE;
+  QByteArray     data;
+  nlohmann::json json;
+
+  if (!ok && !job->mirror_url.empty())
+    Logger::log()->trace("DownloadScheduler: not available from the mirror: {} ({})",
+                         job->url,
+                         reply->errorString().toStdString());
+  else if (!ok)
+    Logger::log()->error("DownloadScheduler: download error: {} ({})",
+                         job->url,
+                         watchdog->has_timed_out() ? watchdog->get_reason() + " timeout"
+                                                   : reply->errorString().toStdString());
+
+  if (part)
+  {
+    ok = part->finish(ok);
+
+    // an invalid partial file has been removed and the download can be restarted from
+    // scratch, a write error or a lack of disk budget cannot be recovered from
+    if (part->write_error || part->quota_error)
+      failure = FailureKind::FATAL;
+    else if (part->range_error || part->check_error)
+      failure = FailureKind::RETRYABLE;
+    else if (!ok && failure == FailureKind::NONE)
+      failure = FailureKind::FATAL;
+  }
+  else if (ok && job->is_json && HttpCache::is_not_modified(reply))
+  {
+    // not modified, use the local copy
+    ok = job->cache.load(job->url, json);
+  }
+  else if (ok && job->is_json)
+  {
+    data = reader->take_body();
+    json = nlohmann::json::parse(data.begin(), data.end(), nullptr, false);
+    data.clear();
+
+    if (json.is_discarded())
+    {
+      Logger::log()->error("DownloadScheduler: JSON parse error: {}", job->url);
+      json = nlohmann::json();
+      ok = false;
+    }
+    else if (job->mirror_url.empty()) // validators from the mirror are meaningless
+      job->cache.store(job->url, reply, json);
+  }
+  else if (ok && job->is_sax && HttpCache::is_not_modified(reply))
+  {
+    ok = job->cache.load_raw(job->url, data);
+  }
+  else if (ok && job->is_sax)
+  {
+    data = reader->take_body();
+
+    // validated without building a document, so that a broken body is never cached
+    if (job->cache.is_enabled() && job->mirror_url.empty() &&
+        nlohmann::json::accept(data.begin(), data.end()))
+      job->cache.store_raw(job->url, reply, data);
+  }
+  else if (ok)
+  {
+    data = reader->take_body();
+  }
+
+  int delay = retry_delay_ms(job->attempt, reply);
+
+  reply->deleteLater();
+  this->in_flight--;
+  this->in_flight_per_host[job->host]--;
+
+  if (!ok && !job->mirror_url.empty())
+  {
+    // straight to upstream, whatever the failure. The data received from the mirror
+    // are not resumed from, the two sources may not serve the same bytes
+    if (part)
+      part->remove();
+
+    job->mirror_url.clear();
+    job->host = helper_get_host(job->url);
+    job->started = false;
+    this->pending[int(job->priority)].push_front(job);
+    this->start_pending();
+  }
+  else if (!ok && failure == FailureKind::RETRYABLE &&
+           job->attempt < QTD_CONFIG->network.max_retries)
+    this->retry_job(job, delay);
+  else
+    this->finish_job(job, ok, data, json);
+}
+
+std::shared_ptr<DownloadScheduler::Job> DownloadScheduler::pop_next_job()
+{
+  int max_per_host = std::max(1, QTD_CONFIG->network.max_requests_per_host);
+
+  // highest priority first, then first come first served, skipping the hosts which
+  // already have enough requests in flight
+  for (int p = int(this->pending.size()) - 1; p >= 0; p--)
+    for (auto it = this->pending[p].begin(); it != this->pending[p].end(); ++it)
+      if (this->in_flight_per_host[(*it)->host] < max_per_host)
+      {
+        std::shared_ptr<Job> job = *it;
+        this->pending[p].erase(it);
+        return job;
+      }
+
+  return nullptr;
+}
+
+void DownloadScheduler::retry_job(const std::shared_ptr<Job> &job, int delay_ms)
+{
+  job->attempt++;
+  job->started = false;
+  job->retry_scheduled = true;
+
+  Logger::log()->warn("DownloadScheduler: retrying {} in {} ms (attempt {})",
+                      job->url,
+                      delay_ms,
+                      job->attempt);
+
+  // back to the front of its queue once the delay is elapsed
+  QTimer::singleShot(delay_ms,
+                     this,
+                     [this, job]()
+                     {
+                       job->retry_scheduled = false;
+                       this->pending[int(job->priority)].push_front(job);
+                       this->start_pending();
+                     });
+
+  // meanwhile the slot can be used by another request
+  this->start_pending();
+}
+
+void DownloadScheduler::start_job(const std::shared_ptr<Job> &job)
+{
+  job->started = true;
+
+  NetworkSession *session = NetworkSession::get_session();
+  bool            from_mirror = !job->mirror_url.empty();
+  QNetworkRequest request = session->make_request(from_mirror ? job->mirror_url
+                                                              : job->url);
+
+  if (job->priority == DownloadPriority::USER)
+    request.setPriority(QNetworkRequest::HighPriority);
+  else if (job->priority == DownloadPriority::BACKGROUND)
+    request.setPriority(QNetworkRequest::LowPriority);
+
+  if ((job->is_json || job->is_sax) && !from_mirror)
+    job->cache.prepare_request(request);
+
+  std::shared_ptr<PartFile> part;
+
+  if (!job->file_path.empty())
+  {
+    part = std::make_shared<PartFile>(job->file_path, job->check);
+
+    if (!part->open())
+    {
+      // callbacks are always called asynchronously
+      QTimer::singleShot(0,
+                         this,
+                         [this, job]() { this->finish_job(job, false, {}, {}); });
+      return;
+    }
+
+    if (part->offset > 0)
+    {
+      Logger::log()->trace("DownloadScheduler: resuming {} from byte {}",
+                           job->url,
+                           part->offset);
+      request.setRawHeader("Range", "bytes=" + QByteArray::number(part->offset) + "-");
+      request.setRawHeader("If-Range", part->validator);
+    }
+  }
+
+  QNetworkReply *reply = session->get_manager()->get(request);
+  ReplyWatchdog *watchdog = new ReplyWatchdog(reply);
+  this->in_flight++;
+  this->in_flight_per_host[job->host]++;
+
+  // data are read within the bandwidth budget of the job, files are written to disk
+  // chunk by chunk, other data are kept in memory
+  RateClass rate_class = job->priority == DownloadPriority::BACKGROUND
+                             ? RateClass::BACKGROUND
+                             : RateClass::FOREGROUND;
+  if (from_mirror)
+    rate_class = RateClass::UNLIMITED;
+
+  ThrottledReader::ChunkCallback on_chunk = nullptr;
+  if (part)
+    on_chunk = [reply, part](const QByteArray &chunk) { part->write(reply, chunk); };
+
+  ThrottledReader *reader = new ThrottledReader(reply, watchdog, rate_class, on_chunk);
+
+  if (part)
+  {
+    this->connect(reply,
+                  &QNetworkReply::downloadProgress,
+                  this,
+                  [job, part](qint64 received, qint64 total)
+                  {
+                    for (auto &callback : job->progress_callbacks)
+                      callback(part->offset + received,
+                               total < 0 ? -1 : part->offset + total);
+                  });
+  }
+
+  this->connect(reader,
+                &ThrottledReader::finished,
+                this,
+                [this, job, reply, watchdog, reader, part]()
+                { this->on_reply_finished(job, reply, watchdog, reader, part); });
+}
+
+void DownloadScheduler::start_pending()
+{
+  int max_in_flight = std::max(1, QTD_CONFIG->network.max_requests_in_flight);
+
+  while (this->in_flight < max_in_flight)
+  {
+    std::shared_ptr<Job> job = this->pop_next_job();
+    if (!job)
+      break;
+
+    this->start_job(job);
+  }
+}
+
+void DownloadScheduler::submit(const std::string &url,
+                               DownloadPriority   priority,
+                               Callback           callback)
+{
+  auto job = std::make_shared<Job>();
+  job->key = "data:" + url;
+  job->url = url;
+  job->priority = priority;
+  job->callbacks.push_back([callback](bool                  ok,
+                                      const QByteArray     &data,
+                                      const nlohmann::json &) { callback(ok, data); });
+
+  this->submit_job(job);
+}
+
+void DownloadScheduler::submit_file(const std::string       &url,
+                                    const std::string       &file_path,
+                                    DownloadPriority         priority,
+                                    FileCallback             callback,
+                                    DownloadProgressCallback progress_callback,
+                                    const FileCheck         &check)
+{
+  auto job = std::make_shared<Job>();
+  job->key = "file:" + url + "\n" + file_path;
+  job->url = url;
+  job->file_path = file_path;
+  job->check = check;
+  job->priority = priority;
+  job->callbacks.push_back([callback](bool ok, const QByteArray &, const nlohmann::json &)
+                           { callback(ok); });
+
+  if (progress_callback)
+    job->progress_callbacks.push_back(progress_callback);
+
+  this->submit_job(job);
+}
+
+void DownloadScheduler::submit_job(const std::shared_ptr<Job> &new_job)
+{
+  // mirror first, if any. JSON documents only if allowed, since they may be outdated
+  Mirror mirror = Mirror::from_config();
+  bool   is_metadata = new_job->is_json || new_job->is_sax;
+
+  if (mirror.is_enabled() && (!is_metadata || QTD_CONFIG->mirror.metadata))
+    new_job->mirror_url = mirror.get_url(new_job->url);
+
+  new_job->host = helper_get_host(new_job->mirror_url.empty() ? new_job->url
+                                                              : new_job->mirror_url);
+
+  auto it = this->jobs.find(new_job->key);
+
+  if (it == this->jobs.end())
+  {
+    this->jobs[new_job->key] = new_job;
+    this->pending[int(new_job->priority)].push_back(new_job);
+    this->start_pending();
+    return;
+  }
+
+  // identical request already pending or in flight, only one transfer
+  std::shared_ptr<Job> job = it->second;
+
+  Logger::log()->trace("DownloadScheduler: coalescing request {}", job->url);
+
+  job->callbacks.insert(job->callbacks.end(),
+                        new_job->callbacks.begin(),
+                        new_job->callbacks.end());
+  job->progress_callbacks.insert(job->progress_callbacks.end(),
+                                 new_job->progress_callbacks.begin(),
+                                 new_job->progress_callbacks.end());
+
+  // raise the priority of the pending request if needed
+  if (!job->started && !job->retry_scheduled && new_job->priority > job->priority)
+  {
+    std::erase(this->pending[int(job->priority)], job);
+    job->priority = new_job->priority;
+    this->pending[int(job->priority)].push_back(job);
+    this->start_pending();
+  }
+}
+
+void DownloadScheduler::submit_json(const std::string &url,
+                                    DownloadPriority   priority,
+                                    JsonCallback       callback,
+                                    const HttpCache   &cache)
+{
+  auto job = std::make_shared<Job>();
+  job->key = "json:" + url;
+  job->url = url;
+  job->is_json = true;
+  job->cache = cache;
+  job->priority = priority;
+  job->callbacks.push_back([callback](bool                  ok,
+                                      const QByteArray &,
+                                      const nlohmann::json &json)
+                           { callback(ok, json); });
+
+  this->submit_job(job);
+}
+
+void DownloadScheduler::submit_sax(const std::string          &url,
+                                   DownloadPriority            priority,
+                                   std::shared_ptr<SaxHandler> handler,
+                                   FileCallback                callback,
+                                   const HttpCache            &cache)
+{
+  auto job = std::make_shared<Job>();
+  job->key = "sax:" + url;
+  job->url = url;
+  job->is_sax = true;
+  job->cache = cache;
+  job->priority = priority;
+  job->callbacks.push_back(
+      [url, handler, callback](bool ok, const QByteArray &data, const nlohmann::json &)
+      {
+        if (ok && !nlohmann::json::sax_parse(data.begin(), data.end(), handler.get()))
+        {
+          Logger::log()->error("DownloadScheduler: JSON parse error: {}", url);
+          ok = false;
+        }
+        callback(ok);
+      });
+
+  this->submit_job(job);
+}
+
+} // namespace qtd
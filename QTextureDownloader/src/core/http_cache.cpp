@@ -0,0 +1,299 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <filesystem>
+#include <fstream>
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QUrl>
+
+#include "qtd/http_cache.hpp"
+#include "qtd/logger.hpp"
+
+namespace qtd
+{
+
+HttpCache::HttpCache(const std::string &cache_dir_) : cache_dir(cache_dir_)
+{
+  if (this->cache_dir.empty())
+    return;
+
+  std::error_code ec;
+  std::filesystem::create_directories(this->cache_dir, ec);
+
+  if (ec)
+  {
+    Logger::log()->error("HttpCache::HttpCache: could not create cache directory {}",
+                         this->cache_dir);
+    this->cache_dir.clear();
+  }
+}
+
+void HttpCache::commit_entry(const std::string   &url,
+                             const QNetworkReply *reply,
+                             const std::string   &tmp_path,
+                             const std::string   &ext) const
+{
+  std::string     base = this->entry_path(url);
+  std::error_code ec;
+
+  // body first (rename), metadata last so that an entry is never advertised without its
+  // body. Only one body form is kept
+  std::filesystem::rename(tmp_path, base + ext, ec);
+
+  if (ec)
+  {
+    Logger::log()->error("HttpCache::commit_entry: could not write cache entry for {}",
+                         url);
+    std::filesystem::remove(tmp_path, ec);
+    return;
+  }
+
+  std::filesystem::remove(base + (ext == ".cbor" ? ".json" : ".cbor"), ec);
+
+  std::string etag = reply->rawHeader("ETag").toStdString();
+  std::string last_modified = reply->rawHeader("Last-Modified").toStdString();
+
+  nlohmann::json meta = {{"url", url},
+                         {"etag", etag},
+                         {"last_modified", last_modified}};
+
+  std::ofstream file(base + ".meta");
+  file << meta.dump();
+}
+
+std::string HttpCache::entry_path(const std::string &url) const
+{
+  QByteArray hash = QCryptographicHash::hash(QByteArray::fromStdString(url),
+                                             QCryptographicHash::Sha1);
+  return this->cache_dir + "/" + hash.toHex().toStdString();
+}
+
+std::string HttpCache::get_cache_dir() const { return this->cache_dir; }
+
+std::string HttpCache::get_raw_tmp_path(const std::string &url) const
+{
+  return this->entry_path(url) + ".json.tmp";
+}
+
+std::vector<std::string> HttpCache::get_urls() const
+{
+  std::vector<std::string> urls;
+
+  if (!this->is_enabled())
+    return urls;
+
+  std::error_code ec;
+
+  for (auto &entry : std::filesystem::directory_iterator(this->cache_dir, ec))
+  {
+    if (entry.path().extension() != ".meta")
+      continue;
+
+    std::ifstream  file(entry.path());
+    nlohmann::json meta = nlohmann::json::parse(file, nullptr, false);
+
+    if (!meta.is_discarded() && meta.contains("url"))
+      urls.push_back(meta["url"].get<std::string>());
+  }
+
+  return urls;
+}
+
+bool HttpCache::has_validators(const QNetworkReply *reply)
+{
+  return reply->hasRawHeader("ETag") || reply->hasRawHeader("Last-Modified");
+}
+
+bool HttpCache::is_enabled() const { return !this->cache_dir.empty(); }
+
+bool HttpCache::is_not_modified(const QNetworkReply *reply)
+{
+  return reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304;
+}
+
+bool HttpCache::load(const std::string &url, nlohmann::json &body) const
+{
+  if (!this->is_enabled())
+    return false;
+
+  std::string   base = this->entry_path(url);
+  std::ifstream file(base + ".cbor", std::ios::binary);
+
+  if (file.is_open())
+    body = nlohmann::json::from_cbor(file, true, false);
+  else
+  {
+    file.open(base + ".json", std::ios::binary);
+    if (!file.is_open())
+      return false;
+
+    body = nlohmann::json::parse(file, nullptr, false);
+  }
+
+  if (body.is_discarded())
+  {
+    Logger::log()->error("HttpCache::load: corrupted cache entry for {}", url);
+    body = nlohmann::json();
+    return false;
+  }
+
+  return true;
+}
+
+bool HttpCache::load_raw(const std::string &url, QByteArray &body) const
+{
+  if (!this->is_enabled())
+    return false;
+
+  QFile file(QString::fromStdString(this->entry_path(url) + ".json"));
+
+  if (file.open(QIODevice::ReadOnly))
+  {
+    body = file.readAll();
+    return true;
+  }
+
+  // entry stored in binary form, converted back to text
+  nlohmann::json json;
+  if (!this->load(url, json))
+    return false;
+
+  body = QByteArray::fromStdString(json.dump());
+  return true;
+}
+
+bool HttpCache::load_sax(const std::string                  &url,
+                         nlohmann::json_sax<nlohmann::json> &handler) const
+{
+  if (!this->is_enabled())
+    return false;
+
+  std::string   base = this->entry_path(url);
+  std::ifstream file(base + ".cbor", std::ios::binary);
+
+  if (file.is_open())
+    return nlohmann::json::sax_parse(file,
+                                     &handler,
+                                     nlohmann::json::input_format_t::cbor);
+
+  file.open(base + ".json", std::ios::binary);
+  if (!file.is_open())
+    return false;
+
+  return nlohmann::json::sax_parse(file, &handler);
+}
+
+void HttpCache::prepare_request(QNetworkRequest &request) const
+{
+  if (!this->is_enabled())
+    return;
+
+  std::string   base = this->entry_path(request.url().toString().toStdString());
+  std::ifstream file(base + ".meta");
+
+  bool has_body = std::filesystem::exists(base + ".cbor") ||
+                  std::filesystem::exists(base + ".json");
+
+  if (!file.is_open() || !has_body)
+    return;
+
+  nlohmann::json meta = nlohmann::json::parse(file, nullptr, false);
+  if (meta.is_discarded())
+    return;
+
+  std::string etag = meta.value("etag", "");
+  std::string last_modified = meta.value("last_modified", "");
+
+  if (!etag.empty())
+    request.setRawHeader("If-None-Match", QByteArray::fromStdString(etag));
+  if (!last_modified.empty())
+    request.setRawHeader("If-Modified-Since", QByteArray::fromStdString(last_modified));
+}
+
+void HttpCache::remove_entry(const std::string &url) const
+{
+  std::string     base = this->entry_path(url);
+  std::error_code ec;
+
+  for (const std::string ext : {".meta", ".cbor", ".json"})
+    std::filesystem::remove(base + ext, ec);
+}
+
+void HttpCache::store(const std::string    &url,
+                      const QNetworkReply  *reply,
+                      const nlohmann::json &body) const
+{
+  if (!this->is_enabled())
+    return;
+
+  // nothing to revalidate with, do not keep a stale entry around
+  if (!HttpCache::has_validators(reply))
+  {
+    this->remove_entry(url);
+    return;
+  }
+
+  std::string tmp_path = this->entry_path(url) + ".cbor.tmp";
+
+  {
+    std::ofstream file(tmp_path, std::ios::binary);
+    if (!file.is_open())
+    {
+      Logger::log()->error("HttpCache::store: could not write cache entry for {}", url);
+      return;
+    }
+
+    nlohmann::json::to_cbor(body, file);
+  }
+
+  this->commit_entry(url, reply, tmp_path, ".cbor");
+}
+
+void HttpCache::store_raw(const std::string   &url,
+                          const QNetworkReply *reply,
+                          const QByteArray    &body) const
+{
+  if (!this->is_enabled())
+    return;
+
+  if (!HttpCache::has_validators(reply))
+  {
+    this->remove_entry(url);
+    return;
+  }
+
+  std::string tmp_path = this->get_raw_tmp_path(url);
+
+  {
+    QFile file(QString::fromStdString(tmp_path));
+    if (!file.open(QIODevice::WriteOnly) || file.write(body) != body.size())
+    {
+      Logger::log()->error("HttpCache::store_raw: could not write cache entry for {}",
+                           url);
+      file.remove();
+      return;
+    }
+  }
+
+  this->commit_entry(url, reply, tmp_path, ".json");
+}
+
+void HttpCache::store_raw_file(const std::string   &url,
+                               const QNetworkReply *reply,
+                               const std::string   &file_path) const
+{
+  if (!this->is_enabled() || !HttpCache::has_validators(reply))
+  {
+    std::error_code ec;
+    std::filesystem::remove(file_path, ec);
+
+    if (this->is_enabled())
+      this->remove_entry(url);
+    return;
+  }
+
+  this->commit_entry(url, reply, file_path, ".json");
+}
+
+} // namespace qtd
@@ -3,6 +3,8 @@
 #include "qtd/image_fetcher.hpp"
 #include "qtd/config.hpp"
 #include "qtd/logger.hpp"
+#include "qtd/network_policy.hpp"
+#include "qtd/network_session.hpp"
 
 namespace qtd
 {
@@ -11,33 +13,17 @@ ImageFetcher::ImageFetcher(QObject *parent) : QObject(parent) {}
 
 QImage ImageFetcher::fetch_sync(const std::string &url, int timeout_ms)
 {
-  QNetworkRequest request(QUrl(QString::fromStdString(url)));
-  QNetworkReply  *reply = manager.get(request);
-
-  QEventLoop loop;
-
-  // stop loop when finished
-  QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-
-  // optional timeout
-  QTimer timer;
-  timer.setSingleShot(true);
-  timer.start(timeout_ms);
-  QObject::connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-
-  loop.exec();
-
-  if (!timer.isActive())
-  {
-    // timeout
-    reply->abort();
-    reply->deleteLater();
+  NetworkSession *session = NetworkSession::get_session();
+  QNetworkRequest request = session->make_request(url);
+  QByteArray      data;
+  QNetworkReply  *reply = get_with_retries(*session->get_manager(),
+                                           request,
+                                           data,
+                                           timeout_ms);
+
+  if (!reply)
     return QImage();
-  }
-
-  timer.stop();
 
-  QByteArray data = reply->readAll();
   reply->deleteLater();
 
   QImage image;
@@ -1,53 +1,243 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
+#include <filesystem>
+#include <istream>
+#include <thread>
+
+#include <QEventLoop>
+#include <QFile>
+
+#include "qtd/byte_stream.hpp"
 #include "qtd/json_fetcher.hpp"
 #include "qtd/config.hpp"
 #include "qtd/logger.hpp"
+#include "qtd/mirror.hpp"
+#include "qtd/network_policy.hpp"
+#include "qtd/network_session.hpp"
+#include "qtd/rate_limiter.hpp"
 
 namespace qtd
 {
 
 JsonFetcher::JsonFetcher(QObject *parent) : QObject(parent) {}
 
-nlohmann::json JsonFetcher::fetch_sync(const std::string &url, int timeout_ms)
+bool JsonFetcher::fetch_sax(const std::string                  &url,
+                            nlohmann::json_sax<nlohmann::json> &handler,
+                            int                                 timeout_ms)
 {
-  QNetworkRequest request(QUrl(QString::fromStdString(url)));
-  QNetworkReply  *reply = manager.get(request);
+  bool   started = false;
+  Mirror mirror = Mirror::from_config();
+
+  // mirror first if allowed, nothing from it is cached since its validators do not
+  // match the upstream ones
+  if (mirror.is_enabled() && QTD_CONFIG->mirror.metadata)
+  {
+    if (this->fetch_sax_from(mirror.get_url(url),
+                             HttpCache(),
+                             handler,
+                             timeout_ms,
+                             RateClass::UNLIMITED,
+                             started))
+      return true;
+
+    // the handler has already been fed, it cannot be fed again
+    if (started)
+      return false;
 
-  QEventLoop loop;
+    Logger::log()->trace("JsonFetcher::fetch_sax: not available from the mirror: {}",
+                         url);
+  }
 
-  // stop loop when finished
-  QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+  return this->fetch_sax_from(url,
+                              this->cache,
+                              handler,
+                              timeout_ms,
+                              RateClass::FOREGROUND,
+                              started);
+}
 
-  // optional timeout
-  QTimer timer;
-  timer.setSingleShot(true);
-  timer.start(timeout_ms);
-  QObject::connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
+bool JsonFetcher::fetch_sax_from(const std::string                  &url,
+                                 const HttpCache                    &cache,
+                                 nlohmann::json_sax<nlohmann::json> &handler,
+                                 int                                 timeout_ms,
+                                 RateClass                           rate_class,
+                                 bool                               &started)
+{
+  NetworkSession *session = NetworkSession::get_session();
+  QNetworkRequest request = session->make_request(url);
+  cache.prepare_request(request);
+  started = false;
 
-  loop.exec();
+  // raw copy of the body, moved to the cache once complete
+  std::string tee_path;
+  if (cache.is_enabled())
+    tee_path = cache.get_raw_tmp_path(url);
 
-  if (!timer.isActive())
+  for (int attempt = 0;; attempt++)
   {
-    // timeout
-    reply->abort();
+    QNetworkReply *reply = session->get_manager()->get(request);
+    ReplyWatchdog *watchdog = new ReplyWatchdog(reply, timeout_ms);
+
+    // the parser runs in a worker thread, started with the first chunk of data
+    ByteStreamBuffer stream;
+    std::thread      parser;
+    bool             parse_ok = false;
+    bool             parse_stopped = false; // before the end of the body
+    bool             status_ok = true;
+    QFile            tee(QString::fromStdString(tee_path));
+
+    auto read_chunk = [&](const QByteArray &chunk)
+    {
+      int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+      // error page or '304 Not Modified', not to be parsed
+      if (status >= 300)
+        status_ok = false;
+      if (!status_ok || parse_stopped || chunk.isEmpty())
+        return;
+
+      if (!parser.joinable())
+      {
+        if (!tee_path.empty())
+          tee.open(QIODevice::WriteOnly | QIODevice::Truncate);
+
+        parser = std::thread(
+            [&stream, &handler, &parse_ok]()
+            {
+              std::istream is(&stream);
+              parse_ok = nlohmann::json::sax_parse(is, &handler);
+              stream.finish();
+            });
+      }
+
+      // blocks while the parser is behind, the rest of the body is not needed once it
+      // is done (parse error)
+      if (!stream.push(chunk.constData(), size_t(chunk.size())))
+      {
+        parse_stopped = true;
+        reply->abort();
+        return;
+      }
+
+      if (tee.isOpen())
+        tee.write(chunk);
+    };
+
+    // chunks are delivered as they are received, within the rate limits
+    ThrottledReader *reader = new ThrottledReader(reply,
+                                                  watchdog,
+                                                  rate_class,
+                                                  read_chunk);
+
+    QEventLoop loop;
+    this->connect(reader, &ThrottledReader::finished, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    FailureKind failure = classify_failure(reply, watchdog);
+    started = parser.joinable();
+
+    // end of stream, the parser fails on a truncated document
+    stream.close();
+    if (started)
+      parser.join();
+    tee.close();
+
+    if (failure == FailureKind::NONE && started && parse_ok)
+    {
+      if (!tee_path.empty())
+        cache.store_raw_file(url, reply, tee_path);
+
+      reply->deleteLater();
+      return true;
+    }
+
+    if (!tee_path.empty())
+      tee.remove();
+
+    if (parse_stopped)
+    {
+      Logger::log()->error("JsonFetcher::fetch_sax: JSON parse error: {}", url);
+      reply->deleteLater();
+      return false;
+    }
+
+    // not modified, replay the local copy
+    if (failure == FailureKind::NONE && HttpCache::is_not_modified(reply))
+    {
+      reply->deleteLater();
+      Logger::log()->trace("JsonFetcher::fetch_sax: not modified, using cache: {}", url);
+      return cache.load_sax(url, handler);
+    }
+
+    if (failure == FailureKind::NONE)
+    {
+      Logger::log()->error("JsonFetcher::fetch_sax: JSON parse error: {}", url);
+      reply->deleteLater();
+      return false;
+    }
+
+    Logger::log()->error("JsonFetcher::fetch_sax: download error: {} ({})",
+                         url,
+                         watchdog->has_timed_out() ? watchdog->get_reason() + " timeout"
+                                                   : reply->errorString().toStdString());
+
+    int delay = retry_delay_ms(attempt, reply);
     reply->deleteLater();
-    return {};
+
+    if (started || failure == FailureKind::FATAL ||
+        attempt >= QTD_CONFIG->network.max_retries)
+      return false;
+
+    Logger::log()->warn("JsonFetcher::fetch_sax: retrying {} in {} ms", url, delay);
+
+    QTimer::singleShot(delay, &loop, &QEventLoop::quit);
+    loop.exec();
   }
+}
 
-  timer.stop();
+nlohmann::json JsonFetcher::fetch_sync(const std::string &url, int timeout_ms)
+{
+  NetworkSession *session = NetworkSession::get_session();
+  QNetworkRequest request = session->make_request(url);
+  this->cache.prepare_request(request);
 
-  QByteArray data = reply->readAll();
-  reply->deleteLater();
+  QByteArray     data;
+  QNetworkReply *reply = get_with_retries(*session->get_manager(),
+                                          request,
+                                          data,
+                                          timeout_ms);
+
+  if (!reply)
+    return {};
+
+  // not modified, use the local copy
+  if (HttpCache::is_not_modified(reply))
+  {
+    reply->deleteLater();
+
+    nlohmann::json j;
+    if (this->cache.load(url, j))
+    {
+      Logger::log()->trace("JsonFetcher::fetch_sync: not modified, using cache: {}", url);
+      return j;
+    }
+    return {};
+  }
 
   try
   {
-    return nlohmann::json::parse(data.constData());
+    nlohmann::json j = nlohmann::json::parse(data.constData());
+    this->cache.store(url, reply, j);
+    reply->deleteLater();
+    return j;
   }
   catch (const nlohmann::json::parse_error &e)
   {
+    reply->deleteLater();
     return {};
   }
 }
 
+void JsonFetcher::set_cache(const HttpCache &new_cache) { this->cache = new_cache; }
+
 } // namespace qtd
@@ -0,0 +1,128 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <filesystem>
+
+#include <QDir>
+#include <QUrl>
+
+#include "qtd/config.hpp"
+#include "qtd/logger.hpp"
+#include "qtd/mirror.hpp"
+#include "qtd/utils.hpp"
+
+namespace qtd
+{
+
+Mirror::Mirror(const std::string &location_) : location(location_)
+{
+  while (this->location.size() > 1 && this->location.back() == '/')
+    this->location.pop_back();
+}
+
+bool Mirror::add_data(const std::string &upstream_url, const QByteArray &data) const
+{
+  if (!this->is_local())
+    return false;
+
+  std::string     path = this->get_local_path(upstream_url);
+  std::error_code ec;
+
+  if (std::filesystem::file_size(path, ec) == uintmax_t(data.size()) && !ec)
+    return true;
+
+  std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+  return save_to_file(data, path, true);
+}
+
+bool Mirror::add_file(const std::string &upstream_url, const std::string &file_path) const
+{
+  if (!this->is_local())
+    return false;
+
+  std::string     path = this->get_local_path(upstream_url);
+  std::error_code ec;
+
+  uintmax_t size = std::filesystem::file_size(file_path, ec);
+  if (ec)
+    return false;
+
+  if (std::filesystem::file_size(path, ec) == size && !ec)
+    return true;
+
+  std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+  // the mirror may be served while being populated, files are renamed once complete
+  std::string tmp_path = path + ".tmp";
+  std::filesystem::remove(tmp_path, ec);
+
+  std::filesystem::create_hard_link(file_path, tmp_path, ec);
+  if (ec)
+  {
+    ec.clear();
+    std::filesystem::copy_file(file_path, tmp_path, ec);
+  }
+
+  if (!ec)
+    std::filesystem::rename(tmp_path, path, ec);
+
+  if (ec)
+  {
+    Logger::log()->error("Mirror::add_file: could not mirror {}: {}",
+                         file_path,
+                         ec.message());
+    std::filesystem::remove(tmp_path, ec);
+    return false;
+  }
+
+  return true;
+}
+
+Mirror Mirror::from_config() { return Mirror(QTD_CONFIG->mirror.location); }
+
+std::string Mirror::get_local_path(const std::string &upstream_url) const
+{
+  return this->location + "/" + Mirror::get_relative_path(upstream_url);
+}
+
+std::string Mirror::get_location() const { return this->location; }
+
+std::string Mirror::get_relative_path(const std::string &upstream_url)
+{
+  QUrl    url(QString::fromStdString(upstream_url));
+  QString path = url.host() + "/" + url.path();
+
+  if (url.hasQuery())
+    path += "@" + url.query();
+
+  // no way out of the mirror
+  path = QDir::cleanPath(path);
+  while (path.startsWith("../") || path.startsWith("/"))
+    path.remove(0, path.indexOf('/') + 1);
+
+  return path.toStdString();
+}
+
+std::string Mirror::get_url(const std::string &upstream_url) const
+{
+  std::string relative_path = Mirror::get_relative_path(upstream_url);
+
+  if (this->is_local())
+    return QUrl::fromLocalFile(QString::fromStdString(this->location + "/" +
+                                                      relative_path))
+        .toString()
+        .toStdString();
+
+  QByteArray encoded = QUrl::toPercentEncoding(QString::fromStdString(relative_path),
+                                               "/");
+  return this->location + "/" + encoded.toStdString();
+}
+
+bool Mirror::is_enabled() const { return !this->location.empty(); }
+
+bool Mirror::is_local() const
+{
+  return this->is_enabled() && this->location.find("://") == std::string::npos;
+}
+
+} // namespace qtd
@@ -0,0 +1,232 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+
+#include <QEventLoop>
+#include <QRandomGenerator>
+
+#include "qtd/config.hpp"
+#include "qtd/logger.hpp"
+#include "qtd/network_policy.hpp"
+
+namespace qtd
+{
+
+// --------------------------
+// ReplyWatchdog
+// --------------------------
+
+ReplyWatchdog::ReplyWatchdog(QNetworkReply *reply, int total_timeout_ms)
+    : QObject(reply), reply(reply)
+{
+  const auto &config = QTD_CONFIG->network;
+
+  if (total_timeout_ms < 0)
+    total_timeout_ms = config.total_timeout_ms;
+
+  this->connect_timer.setSingleShot(true);
+  this->idle_timer.setSingleShot(true);
+  this->total_timer.setSingleShot(true);
+
+  this->connect(&this->connect_timer,
+                &QTimer::timeout,
+                this,
+                [this]() { this->on_timeout("connect"); });
+  this->connect(&this->idle_timer,
+                &QTimer::timeout,
+                this,
+                [this]() { this->on_timeout("idle"); });
+  this->connect(&this->total_timer,
+                &QTimer::timeout,
+                this,
+                [this]() { this->on_timeout("total"); });
+
+  // response headers received
+  this->connect(reply,
+                &QNetworkReply::metaDataChanged,
+                this,
+                [this]() { this->connect_timer.stop(); });
+
+  // any data received
+  this->connect(reply,
+                &QNetworkReply::downloadProgress,
+                this,
+                [this]()
+                {
+                  this->connect_timer.stop();
+                  if (this->idle_timer.isActive())
+                    this->idle_timer.start();
+                });
+
+  this->connect(reply,
+                &QNetworkReply::finished,
+                this,
+                [this]()
+                {
+                  this->connect_timer.stop();
+                  this->idle_timer.stop();
+                  this->total_timer.stop();
+                });
+
+  if (config.connect_timeout_ms > 0)
+    this->connect_timer.start(config.connect_timeout_ms);
+
+  if (config.idle_timeout_ms > 0)
+    this->idle_timer.start(config.idle_timeout_ms);
+
+  if (total_timeout_ms > 0)
+    this->total_timer.start(total_timeout_ms);
+}
+
+std::string ReplyWatchdog::get_reason() const { return this->reason; }
+
+bool ReplyWatchdog::has_timed_out() const { return this->timed_out; }
+
+void ReplyWatchdog::on_timeout(const std::string &timeout_reason)
+{
+  if (this->reply->isFinished())
+    return;
+
+  Logger::log()->warn("ReplyWatchdog: {} timeout, aborting {}",
+                      timeout_reason,
+                      this->reply->url().toString().toStdString());
+
+  this->timed_out = true;
+  this->reason = timeout_reason;
+  this->reply->abort();
+}
+
+void ReplyWatchdog::set_idle_check(bool enabled)
+{
+  int idle_timeout_ms = QTD_CONFIG->network.idle_timeout_ms;
+
+  if (!enabled)
+    this->idle_timer.stop();
+  else if (idle_timeout_ms > 0 && !this->reply->isFinished())
+    this->idle_timer.start(idle_timeout_ms);
+}
+
+// --------------------------
+// functions
+// --------------------------
+
+FailureKind classify_failure(const QNetworkReply *reply, const ReplyWatchdog *watchdog)
+{
+  int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+  // HTTP status first, it is still available if the reply has been aborted
+  if (status >= 400)
+  {
+    switch (status)
+    {
+    case 408: // request timeout
+    case 425: // too early
+    case 429: // too many requests
+    case 500:
+    case 502:
+    case 503:
+    case 504:
+      return FailureKind::RETRYABLE;
+    default:
+      return FailureKind::FATAL;
+    }
+  }
+
+  if (watchdog && watchdog->has_timed_out())
+    return FailureKind::RETRYABLE;
+
+  switch (reply->error())
+  {
+  case QNetworkReply::NoError:
+    return FailureKind::NONE;
+
+  case QNetworkReply::ConnectionRefusedError:
+  case QNetworkReply::RemoteHostClosedError:
+  case QNetworkReply::HostNotFoundError:
+  case QNetworkReply::TimeoutError:
+  case QNetworkReply::TemporaryNetworkFailureError:
+  case QNetworkReply::NetworkSessionFailedError:
+  case QNetworkReply::ProxyConnectionRefusedError:
+  case QNetworkReply::ProxyConnectionClosedError:
+  case QNetworkReply::ProxyTimeoutError:
+  case QNetworkReply::UnknownNetworkError:
+  case QNetworkReply::ProtocolFailure:
+  case QNetworkReply::InternalServerError:
+  case QNetworkReply::ServiceUnavailableError:
+  case QNetworkReply::UnknownServerError:
+    return FailureKind::RETRYABLE;
+
+  default:
+    return FailureKind::FATAL;
+  }
+}
+
+QNetworkReply *get_with_retries(QNetworkAccessManager &manager,
+                                const QNetworkRequest &request,
+                                QByteArray            &body,
+                                int                    total_timeout_ms,
+                                RateClass              rate_class)
+{
+  const std::string url = request.url().toString().toStdString();
+
+  for (int attempt = 0;; attempt++)
+  {
+    QNetworkReply   *reply = manager.get(request);
+    ReplyWatchdog   *watchdog = new ReplyWatchdog(reply, total_timeout_ms);
+    ThrottledReader *reader = new ThrottledReader(reply, watchdog, rate_class);
+
+    QEventLoop loop;
+    QObject::connect(reader, &ThrottledReader::finished, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    FailureKind failure = classify_failure(reply, watchdog);
+
+    if (failure == FailureKind::NONE)
+    {
+      body = reader->take_body();
+      return reply;
+    }
+
+    Logger::log()->error("get_with_retries: download error: {} ({})",
+                         url,
+                         watchdog->has_timed_out() ? watchdog->get_reason() + " timeout"
+                                                   : reply->errorString().toStdString());
+
+    int delay = retry_delay_ms(attempt, reply);
+    reply->deleteLater();
+
+    if (failure == FailureKind::FATAL || attempt >= QTD_CONFIG->network.max_retries)
+      return nullptr;
+
+    Logger::log()->warn("get_with_retries: retrying {} in {} ms", url, delay);
+
+    QTimer::singleShot(delay, &loop, &QEventLoop::quit);
+    loop.exec();
+  }
+}
+
+int retry_delay_ms(int attempt, const QNetworkReply *reply)
+{
+  const auto &config = QTD_CONFIG->network;
+
+  // server hint, in seconds (HTTP-date form not supported)
+  if (reply && reply->hasRawHeader("Retry-After"))
+  {
+    bool ok = false;
+    int  seconds = reply->rawHeader("Retry-After").toInt(&ok);
+    if (ok && seconds >= 0) // in 64 bits, the header comes from the network
+      return int(std::min(int64_t(seconds) * 1000,
+                          int64_t(config.retry_backoff_max_ms)));
+  }
+
+  int64_t delay = config.retry_backoff_ms;
+  for (int k = 0; k < attempt && delay < config.retry_backoff_max_ms; k++)
+    delay *= 2;
+  delay = std::min(delay, int64_t(config.retry_backoff_max_ms));
+
+  // "equal jitter", in [delay / 2, delay]
+  int half = int(delay / 2);
+  return half + int(QRandomGenerator::global()->bounded(half + 1));
+}
+
+} // namespace qtd
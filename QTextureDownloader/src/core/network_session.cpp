@@ -0,0 +1,62 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <QCoreApplication>
+#include <QUrl>
+
+#if QT_CONFIG(ssl)
+#include <QSslConfiguration>
+#endif
+
+#include "qtd/config.hpp"
+#include "qtd/logger.hpp"
+#include "qtd/network_session.hpp"
+
+namespace qtd
+{
+
+QPointer<NetworkSession> NetworkSession::instance = nullptr;
+
+NetworkSession::NetworkSession(QObject *parent) : QObject(parent)
+{
+  this->manager.setRedirectPolicy(QNetworkRequest::NoLessSafeRedirectPolicy);
+}
+
+QNetworkAccessManager *NetworkSession::get_manager() { return &this->manager; }
+
+NetworkSession *NetworkSession::get_session()
+{
+  // owned by the application, deleted along with it
+  if (!instance)
+    instance = new NetworkSession(QCoreApplication::instance());
+  return instance;
+}
+
+QNetworkRequest NetworkSession::make_request(const std::string &url) const
+{
+  QNetworkRequest request(QUrl(QString::fromStdString(url)));
+  request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+  request.setHeader(QNetworkRequest::UserAgentHeader,
+                    QString::fromStdString(QTD_CONFIG->network.user_agent));
+  return request;
+}
+
+void NetworkSession::preconnect()
+{
+  for (auto &host : QTD_CONFIG->network.preconnect_hosts)
+  {
+    Logger::log()->trace("NetworkSession::preconnect: {}", host);
+
+#if QT_CONFIG(ssl)
+    // advertise HTTP/2 so that the connection can be reused by the requests
+    QSslConfiguration ssl_config = QSslConfiguration::defaultConfiguration();
+    ssl_config.setAllowedNextProtocols({QSslConfiguration::ALPNProtocolHTTP2,
+                                        QSslConfiguration::NextProtocolHttp1_1});
+
+    this->manager.connectToHostEncrypted(QString::fromStdString(host), 443, ssl_config);
+#else
+    this->manager.connectToHost(QString::fromStdString(host), 80);
+#endif
+  }
+}
+
+} // namespace qtd
@@ -0,0 +1,218 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <QCryptographicHash>
+
+#include "qtd/poly_haven_sax.hpp"
+#include "qtd/logger.hpp"
+#include "qtd/texture.hpp"
+
+namespace qtd
+{
+
+// --------------------------
+// SaxPathHandler
+// --------------------------
+
+bool SaxPathHandler::binary(binary_t &) { return true; }
+
+bool SaxPathHandler::boolean(bool) { return true; }
+
+bool SaxPathHandler::end_array()
+{
+  this->path.pop_back();
+  return true;
+}
+
+bool SaxPathHandler::end_object()
+{
+  this->path.pop_back();
+  return true;
+}
+
+bool SaxPathHandler::key(string_t &val)
+{
+  this->path.back() = val;
+  return true;
+}
+
+bool SaxPathHandler::null() { return true; }
+
+bool SaxPathHandler::number_float(number_float_t, const string_t &) { return true; }
+
+bool SaxPathHandler::number_integer(number_integer_t val)
+{
+  this->on_integer(val);
+  return true;
+}
+
+bool SaxPathHandler::number_unsigned(number_unsigned_t val)
+{
+  this->on_integer(int64_t(val));
+  return true;
+}
+
+bool SaxPathHandler::parse_error(std::size_t        position,
+                                 const std::string &,
+                                 const nlohmann::detail::exception &ex)
+{
+  Logger::log()->error("SaxPathHandler::parse_error: at byte {}: {}",
+                       position,
+                       ex.what());
+  return false;
+}
+
+bool SaxPathHandler::start_array(std::size_t)
+{
+  this->path.emplace_back("[]");
+  return true;
+}
+
+bool SaxPathHandler::start_object(std::size_t)
+{
+  this->on_start_object();
+  this->path.emplace_back(); // key set later on
+  return true;
+}
+
+bool SaxPathHandler::string(string_t &val)
+{
+  this->on_string(val);
+  return true;
+}
+
+// --------------------------
+// PolyHavenAssetListSax
+// --------------------------
+
+// { "asset_id": { "name": "...", "tags": ["...", ...], ... }, ... }
+
+void PolyHavenAssetListSax::on_integer(int64_t val)
+{
+  if (this->path.size() == 2 && this->path[1] == "date_published")
+    this->assets[this->path[0]].date_published = val;
+}
+
+void PolyHavenAssetListSax::on_start_object()
+{
+  // new asset, even if none of its fields are picked up
+  if (this->path.size() == 1)
+    this->assets[this->path[0]];
+}
+
+void PolyHavenAssetListSax::on_string(const std::string &val)
+{
+  if (this->path.size() == 2)
+  {
+    const std::string &field = this->path[1];
+
+    if (field == "name")
+      this->assets[this->path[0]].name = val;
+    else if (field == "thumbnail_url")
+      this->assets[this->path[0]].thumbnail_url = val;
+    else if (field == "files_hash")
+      this->assets[this->path[0]].files_hash = val;
+  }
+  else if (this->path.size() == 3 && this->path[1] == "tags")
+    this->assets[this->path[0]].tags.push_back(val);
+}
+
+// --------------------------
+// PolyHavenFilesSax
+// --------------------------
+
+// { "Diffuse": { "1k": { "png": { "url": "...", ... }, ... }, ... }, ... }
+
+PolyHavenFilesSax::PolyHavenFilesSax(Texture &texture_) : texture(texture_) {}
+
+int PolyHavenFilesSax::get_count() const { return this->count; }
+
+bool PolyHavenFilesSax::get_texture_type(TextureType &type) const
+{
+  if (this->path.size() != 4 || this->path[2] != "png")
+    return false;
+
+  const std::string &map = this->path[0];
+
+  if (map == "Diffuse")
+    type = TextureType::DIFFUSE;
+  else if (map == "nor_gl")
+    type = TextureType::NORMAL;
+  else if (map == "Displacement")
+    type = TextureType::DISPLACEMENT;
+  else
+    return false;
+
+  return true;
+}
+
+void PolyHavenFilesSax::on_integer(int64_t val)
+{
+  TextureType type;
+
+  if (!this->get_texture_type(type) || this->path[3] != "size")
+    return;
+
+  std::string key = this->path[0] + "/" + this->path[1];
+
+  this->sizes[key] = val;
+  this->texture.set_texture_file_info(type,
+                                      this->path[1],
+                                      TextureFileInfo{val, this->md5s[key]});
+}
+
+void PolyHavenFilesSax::on_string(const std::string &val)
+{
+  TextureType type;
+
+  if (!this->get_texture_type(type))
+    return;
+
+  if (this->path[3] == "url")
+  {
+    this->texture.set_texture_url(type, this->path[1], val);
+    this->count++;
+  }
+  else if (this->path[3] == "md5")
+  {
+    std::string key = this->path[0] + "/" + this->path[1];
+
+    this->md5s[key] = val;
+    this->texture.set_texture_file_info(type,
+                                        this->path[1],
+                                        TextureFileInfo{this->sizes[key], val});
+  }
+}
+
+// --------------------------
+// helpers
+// --------------------------
+
+std::string poly_haven_fingerprint(const PolyHavenAsset &asset)
+{
+  // 'files_hash' changes whenever the asset files are modified upstream, fallback to a
+  // digest of the listed fields if not available. The fingerprint is stored in the
+  // catalog, hence a digest and not std::hash, which is not stable across builds
+  std::string files_hash = asset.files_hash;
+
+  if (files_hash.empty())
+  {
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    // fields null terminated, not to be shifted from one to the next
+    auto add_field = [&hash](const std::string &field)
+    {
+      hash.addData(QByteArray::fromRawData(field.c_str(), qsizetype(field.size()) + 1));
+    };
+
+    add_field(asset.name);
+    add_field(asset.thumbnail_url);
+    for (auto &tag : asset.tags)
+      add_field(tag);
+
+    files_hash = hash.result().toHex().toStdString();
+  }
+
+  return files_hash + "_" + std::to_string(asset.date_published);
+}
+
+} // namespace qtd
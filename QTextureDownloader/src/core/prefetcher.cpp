@@ -0,0 +1,237 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <tuple>
+
+#include <QCoreApplication>
+#include <QEvent>
+#include <QPointer>
+
+#include "qtd/config.hpp"
+#include "qtd/download_scheduler.hpp"
+#include "qtd/logger.hpp"
+#include "qtd/prefetcher.hpp"
+
+namespace qtd
+{
+
+Prefetcher::Prefetcher(TextureManager *texture_manager_, QObject *parent)
+    : QObject(parent), texture_manager(texture_manager_),
+      enabled(QTD_CONFIG->prefetch.enabled)
+{
+  this->idle_timer.setSingleShot(true);
+  this->idle_timer.setInterval(QTD_CONFIG->prefetch.idle_delay_ms);
+  this->connect(&this->idle_timer, &QTimer::timeout, this, [this]() { this->on_idle(); });
+
+  // any user input postpones the prefetching
+  QCoreApplication::instance()->installEventFilter(this);
+}
+
+void Prefetcher::build_queue()
+{
+  this->queue.clear();
+
+  if (!this->enabled)
+    return;
+
+  // current resolution first, then the closest ones, lower before higher
+  std::vector<TextureRes> resolutions = {this->res};
+
+  int pos = int(std::find(all_texture_res.begin(), all_texture_res.end(), this->res) -
+                all_texture_res.begin());
+  int n = int(all_texture_res.size());
+
+  for (int d = 1; d <= QTD_CONFIG->prefetch.neighbor_resolutions && pos < n; d++)
+  {
+    if (pos - d >= 0)
+      resolutions.push_back(all_texture_res[pos - d]);
+    if (pos + d < n)
+      resolutions.push_back(all_texture_res[pos + d]);
+  }
+
+  // missing bytes of the pinned materials, by resolution (-1 if nothing is missing).
+  // Gathered in one pass, the details loaded only for this are released right away
+  std::vector<std::pair<std::string, std::vector<int64_t>>> missing;
+
+  for (auto &[id, tex] : this->texture_manager->get_textures())
+  {
+    if (!tex.get_is_pinned())
+      continue;
+
+    bool                 details_loaded = tex.is_details_loaded();
+    std::vector<int64_t> bytes(resolutions.size(), -1);
+
+    for (size_t k = 0; k < resolutions.size(); k++)
+      for (auto &type : all_texture_types)
+      {
+        TextureKey key(id, type, resolutions[k]);
+
+        if (!tex.has_texture(type, resolutions[k]) ||
+            this->texture_manager->is_texture_file_valid(
+                key,
+                this->texture_manager->get_texture_path(key)))
+          continue;
+
+        bytes[k] = std::max(bytes[k], int64_t(0)) +
+                   tex.get_texture_file_info(type, resolutions[k]).size;
+      }
+
+    if (!details_loaded)
+      tex.release_details();
+
+    missing.push_back({id, bytes});
+  }
+
+  // materials with missing maps only, within the disk budget (sizes from the
+  // upstream metadata, unknown sizes are not accounted for)
+  int64_t planned = 0;
+  bool    budget_reached = false;
+
+  for (size_t k = 0; k < resolutions.size() && !budget_reached; k++)
+  {
+    for (auto &[id, bytes] : missing)
+    {
+      if (bytes[k] < 0)
+        continue;
+
+      if (planned + bytes[k] > QTD_CONFIG->prefetch.max_bytes)
+      {
+        budget_reached = true;
+        break;
+      }
+
+      planned += bytes[k];
+      this->queue.push_back({id, resolutions[k]});
+    }
+  }
+
+  if (budget_reached)
+    Logger::log()->info("Prefetcher::build_queue: disk budget reached");
+
+  Logger::log()->trace("Prefetcher::build_queue: {} material(s) to prefetch ({} MB)",
+                       this->queue.size(),
+                       planned / (1024 * 1024));
+}
+
+bool Prefetcher::eventFilter(QObject *watched, QEvent *event)
+{
+  switch (event->type())
+  {
+  case QEvent::KeyPress:
+  case QEvent::MouseButtonPress:
+  case QEvent::MouseMove:
+  case QEvent::Wheel:
+    if (this->enabled && !this->queue.empty())
+      this->idle_timer.start();
+    break;
+  default:
+    break;
+  }
+
+  return QObject::eventFilter(watched, event);
+}
+
+bool Prefetcher::is_enabled() const { return this->enabled; }
+
+void Prefetcher::on_idle()
+{
+  // the user downloads, if any, come first
+  if (!DownloadScheduler::get_scheduler()->is_idle())
+  {
+    this->idle_timer.start();
+    return;
+  }
+
+  this->prefetch_next();
+}
+
+void Prefetcher::prefetch_next()
+{
+  if (this->busy || !this->enabled)
+    return;
+
+  // the database may have changed since the plan was made
+  std::vector<TextureType> types;
+  std::string              id;
+  TextureRes               r = TextureRes::RUNKNOWN;
+
+  while (types.empty() && !this->queue.empty())
+  {
+    std::tie(id, r) = this->queue.front();
+    this->queue.pop_front();
+
+    auto it = this->texture_manager->get_textures().find(id);
+
+    if (it != this->texture_manager->get_textures().end() && it->second.get_is_pinned())
+      for (auto &type : all_texture_types)
+        if (it->second.has_texture(type, r))
+          types.push_back(type);
+  }
+
+  if (types.empty())
+    return;
+
+  Logger::log()->trace("Prefetcher::prefetch_next: {} ({})",
+                       id,
+                       texture_res_as_string.at(r));
+
+  this->busy = true;
+
+  QPointer<Prefetcher> self(this);
+
+  this->texture_manager->retrieve_material(
+      id,
+      types,
+      r,
+      [self](const MaterialResult &result)
+      {
+        if (!self)
+          return;
+
+        if (!result.complete)
+          Logger::log()->warn("Prefetcher: could not prefetch {}", result.id);
+
+        self->busy = false;
+
+        // next one right away, unless the user has been active in the meantime
+        if (!self->idle_timer.isActive())
+          self->prefetch_next();
+      },
+      nullptr,
+      false,
+      DownloadPriority::BACKGROUND);
+}
+
+void Prefetcher::reset()
+{
+  this->build_queue();
+
+  if (!this->queue.empty())
+    this->idle_timer.start();
+}
+
+void Prefetcher::set_enabled(bool new_state)
+{
+  this->enabled = new_state;
+
+  if (this->enabled)
+  {
+    this->reset();
+  }
+  else
+  {
+    this->queue.clear();
+    this->idle_timer.stop();
+  }
+}
+
+void Prefetcher::set_resolution(const TextureRes &new_res)
+{
+  if (new_res == this->res)
+    return;
+
+  this->res = new_res;
+  this->reset();
+}
+
+} // namespace qtd
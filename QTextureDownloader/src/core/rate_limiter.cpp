@@ -0,0 +1,210 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <cmath>
+
+#include <QCoreApplication>
+#include <QTimer>
+
+#include "qtd/config.hpp"
+#include "qtd/logger.hpp"
+#include "qtd/network_policy.hpp"
+#include "qtd/rate_limiter.hpp"
+
+namespace qtd
+{
+
+// bucket capacity, in seconds worth of data: the smaller, the smoother the throughput
+constexpr double RATE_LIMITER_BURST_S = 0.25;
+constexpr double RATE_LIMITER_MIN_READ = 4096.0; // bytes
+
+// --------------------------
+// RateLimiter
+// --------------------------
+
+QPointer<RateLimiter> RateLimiter::instance = nullptr;
+
+RateLimiter::RateLimiter(QObject *parent) : QObject(parent) {}
+
+int64_t RateLimiter::acquire(RateClass rate_class, int64_t wanted)
+{
+  Bucket &bucket = this->refill(rate_class);
+
+  if (this->get_max_rate(rate_class) <= 0)
+    return wanted;
+
+  if (bucket.tokens <= 0.0)
+    return 0;
+
+  int64_t size = std::min(wanted, int64_t(bucket.tokens));
+  bucket.tokens -= double(size);
+  return size;
+}
+
+void RateLimiter::consume(RateClass rate_class, int64_t size)
+{
+  Bucket &bucket = this->refill(rate_class);
+
+  if (this->get_max_rate(rate_class) > 0)
+    bucket.tokens -= double(size);
+}
+
+RateLimiter *RateLimiter::get_limiter()
+{
+  // owned by the application, deleted along with it
+  if (!instance)
+    instance = new RateLimiter(QCoreApplication::instance());
+  return instance;
+}
+
+int64_t RateLimiter::get_max_rate(RateClass rate_class) const
+{
+  const auto &config = QTD_CONFIG->network;
+
+  switch (rate_class)
+  {
+  case RateClass::FOREGROUND:
+    return config.max_rate_foreground;
+  case RateClass::BACKGROUND:
+    return config.max_rate_background;
+  default:
+    return 0;
+  }
+}
+
+int RateLimiter::get_wait_ms(RateClass rate_class)
+{
+  Bucket &bucket = this->refill(rate_class);
+  double  rate = double(this->get_max_rate(rate_class));
+
+  if (rate <= 0.0)
+    return 0;
+
+  // time to refill the debt, plus a minimal read so that reads are not too small
+  double min_read = std::min(RATE_LIMITER_MIN_READ, rate * RATE_LIMITER_BURST_S);
+  double missing = min_read - bucket.tokens;
+
+  return std::clamp(int(std::ceil(1000.0 * missing / rate)), 1, 1000);
+}
+
+RateLimiter::Bucket &RateLimiter::refill(RateClass rate_class)
+{
+  Bucket &bucket = this->buckets[int(rate_class)];
+  auto    now = std::chrono::steady_clock::now();
+  double  rate = double(this->get_max_rate(rate_class));
+  double  capacity = std::max(rate * RATE_LIMITER_BURST_S, 1.0);
+
+  if (!bucket.started)
+  {
+    bucket.started = true;
+    bucket.tokens = capacity;
+  }
+  else
+  {
+    std::chrono::duration<double> elapsed = now - bucket.last_refill;
+    bucket.tokens = std::min(bucket.tokens + rate * elapsed.count(), capacity);
+  }
+
+  bucket.last_refill = now;
+  return bucket;
+}
+
+void RateLimiter::set_max_rate(RateClass rate_class, int64_t bytes_per_s)
+{
+  if (rate_class == RateClass::UNLIMITED)
+    return;
+
+  auto &config = QTD_CONFIG->network;
+
+  Logger::log()->info("RateLimiter::set_max_rate: {} rate: {} bytes/s",
+                      rate_class == RateClass::FOREGROUND ? "foreground" : "background",
+                      bytes_per_s);
+
+  // settle the bucket with the previous rate first
+  this->refill(rate_class);
+
+  if (rate_class == RateClass::FOREGROUND)
+    config.max_rate_foreground = std::max(int64_t(0), bytes_per_s);
+  else
+    config.max_rate_background = std::max(int64_t(0), bytes_per_s);
+
+  // clamped to the new capacity
+  this->refill(rate_class);
+}
+
+// --------------------------
+// ThrottledReader
+// --------------------------
+
+ThrottledReader::ThrottledReader(QNetworkReply *reply,
+                                 ReplyWatchdog *watchdog,
+                                 RateClass      rate_class,
+                                 ChunkCallback  on_chunk)
+    : QObject(reply), reply(reply), watchdog(watchdog), rate_class(rate_class),
+      on_chunk(on_chunk)
+{
+  // bounded, so that unread data actually slow down the transfer
+  reply->setReadBufferSize(QTD_CONFIG->network.read_buffer_size);
+
+  this->connect(reply, &QNetworkReply::readyRead, this, [this]() { this->pump(); });
+  this->connect(reply, &QNetworkReply::finished, this, [this]() { this->pump(); });
+}
+
+void ThrottledReader::pump()
+{
+  if (this->done || this->waiting)
+    return;
+
+  RateLimiter *limiter = RateLimiter::get_limiter();
+
+  while (this->reply->bytesAvailable() > 0)
+  {
+    int64_t available = this->reply->bytesAvailable();
+    int64_t size = available;
+
+    // once finished, what is left (at most a read buffer) is read at once and paid
+    // back by the next transfers
+    if (this->reply->isFinished())
+      limiter->consume(this->rate_class, size);
+    else
+      size = limiter->acquire(this->rate_class, available);
+
+    if (size == 0)
+    {
+      // budget exhausted, the transfer is not stalled, it is waiting for us
+      this->waiting = true;
+      this->watchdog->set_idle_check(false);
+
+      QTimer::singleShot(limiter->get_wait_ms(this->rate_class),
+                         this,
+                         [this]()
+                         {
+                           this->waiting = false;
+                           this->watchdog->set_idle_check(true);
+                           this->pump();
+                         });
+      return;
+    }
+
+    QByteArray chunk = this->reply->read(size);
+
+    if (this->on_chunk)
+      this->on_chunk(chunk);
+    else
+      this->body.append(chunk);
+
+    // the callback may have aborted the reply, which is then already finished
+    if (this->done)
+      return;
+  }
+
+  if (this->reply->isFinished())
+  {
+    this->done = true;
+    Q_EMIT this->finished();
+  }
+}
+
+QByteArray ThrottledReader::take_body() { return std::move(this->body); }
+
+} // namespace qtd
@@ -0,0 +1,306 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <bit>
+#include <cctype>
+
+#include "qtd/logger.hpp"
+#include "qtd/search_index.hpp"
+#include "qtd/texture.hpp"
+
+namespace qtd
+{
+
+// fuzzy matching: words shorter than that are only matched as prefixes, and a term
+// matches if the share of trigrams in common (Jaccard index) is at least the threshold
+constexpr size_t SEARCH_INDEX_FUZZY_MIN_LENGTH = 3;
+constexpr float  SEARCH_INDEX_FUZZY_THRESHOLD = 0.3f;
+
+// lower case words, bytes above 127 being part of the words (UTF-8)
+std::vector<std::string> helper_split_words(std::string_view text)
+{
+  std::vector<std::string> words;
+  std::string              word;
+
+  for (char c : text)
+  {
+    unsigned char u = static_cast<unsigned char>(c);
+
+    if (std::isalnum(u) || u > 127)
+    {
+      word.push_back(char(std::tolower(u)));
+    }
+    else if (!word.empty())
+    {
+      words.push_back(word);
+      word.clear();
+    }
+  }
+
+  if (!word.empty())
+    words.push_back(word);
+
+  return words;
+}
+
+// distinct trigrams, each packed in an integer
+std::vector<uint32_t> helper_trigrams(const std::string &term)
+{
+  std::string           padded = "  " + term + " ";
+  std::vector<uint32_t> out;
+
+  for (size_t k = 0; k + 2 < padded.size(); k++)
+    out.push_back(uint32_t(uint8_t(padded[k])) << 16 |
+                  uint32_t(uint8_t(padded[k + 1])) << 8 |
+                  uint32_t(uint8_t(padded[k + 2])));
+
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+
+  return out;
+}
+
+void SearchIndex::add(const std::string &id, const Texture &texture)
+{
+  std::vector<uint32_t> doc_term_ids;
+
+  for (auto *text : {&texture.get_name(), &texture.get_source()})
+    for (auto &word : helper_split_words(*text))
+      doc_term_ids.push_back(this->intern(word));
+
+  for (auto &tag : texture.get_tags())
+    for (auto &word : helper_split_words(tag))
+      doc_term_ids.push_back(this->intern(word));
+
+  std::sort(doc_term_ids.begin(), doc_term_ids.end());
+  doc_term_ids.erase(std::unique(doc_term_ids.begin(), doc_term_ids.end()),
+                     doc_term_ids.end());
+
+  this->remove(id);
+  this->add_document(id, doc_term_ids);
+  this->dirty = true;
+}
+
+void SearchIndex::add_document(const std::string           &id,
+                               const std::vector<uint32_t> &doc_term_ids)
+{
+  uint32_t doc;
+
+  // slots of the removed documents are reused
+  if (!this->free_docs.empty())
+  {
+    doc = this->free_docs.back();
+    this->free_docs.pop_back();
+    this->doc_ids[doc] = id;
+    this->doc_terms[doc] = doc_term_ids;
+  }
+  else
+  {
+    doc = uint32_t(this->doc_ids.size());
+    this->doc_ids.push_back(id);
+    this->doc_terms.push_back(doc_term_ids);
+  }
+
+  this->docs[id] = doc;
+
+  for (auto &term_id : doc_term_ids)
+  {
+    std::vector<uint32_t> &posting = this->postings[term_id];
+    posting.insert(std::lower_bound(posting.begin(), posting.end(), doc), doc);
+  }
+}
+
+bool SearchIndex::contains(const std::string &id) const
+{
+  return this->docs.contains(id);
+}
+
+std::vector<std::string> SearchIndex::get_ids() const
+{
+  std::vector<std::string> ids;
+  ids.reserve(this->docs.size());
+
+  for (auto &[id, _] : this->docs)
+    ids.push_back(id);
+
+  return ids;
+}
+
+uint32_t SearchIndex::intern(const std::string &term)
+{
+  auto it = this->term_ids.find(term);
+  if (it != this->term_ids.end())
+    return it->second;
+
+  uint32_t term_id = uint32_t(this->terms.size());
+
+  this->terms.push_back(term);
+  this->term_ids[term] = term_id;
+  this->postings.emplace_back();
+
+  for (auto &trigram : helper_trigrams(term))
+    this->trigrams[trigram].push_back(term_id);
+
+  return term_id;
+}
+
+bool SearchIndex::is_dirty() const { return this->dirty; }
+
+void SearchIndex::json_from(nlohmann::json const &json)
+{
+  *this = SearchIndex();
+
+  if (!json.is_object())
+    return;
+
+  for (auto &term : json.value("terms", std::vector<std::string>()))
+    this->intern(term);
+
+  nlohmann::json json_docs = json.value("docs", nlohmann::json::object());
+
+  for (auto &[id, value] : json_docs.items())
+  {
+    std::vector<uint32_t> doc_term_ids = value.get<std::vector<uint32_t>>();
+
+    std::erase_if(doc_term_ids,
+                  [this](uint32_t term_id) { return term_id >= this->terms.size(); });
+
+    this->add_document(id, doc_term_ids);
+  }
+
+  Logger::log()->trace("SearchIndex::json_from: {} texture(s), {} term(s)",
+                       this->docs.size(),
+                       this->terms.size());
+}
+
+nlohmann::json SearchIndex::json_to() const
+{
+  // only the terms still in use, renumbered
+  std::vector<uint32_t> new_ids(this->terms.size(), 0);
+  nlohmann::json        json_terms = nlohmann::json::array();
+
+  for (uint32_t term_id = 0; term_id < this->terms.size(); term_id++)
+    if (!this->postings[term_id].empty())
+    {
+      new_ids[term_id] = uint32_t(json_terms.size());
+      json_terms.push_back(this->terms[term_id]);
+    }
+
+  nlohmann::json json_docs = nlohmann::json::object();
+
+  for (auto &[id, doc] : this->docs)
+  {
+    std::vector<uint32_t> doc_term_ids;
+
+    for (auto &term_id : this->doc_terms[doc])
+      doc_term_ids.push_back(new_ids[term_id]);
+
+    json_docs[id] = doc_term_ids;
+  }
+
+  return {{"terms", json_terms}, {"docs", json_docs}};
+}
+
+void SearchIndex::match_word(const std::string &word, std::vector<uint64_t> &bits) const
+{
+  auto set_documents = [this, &bits](uint32_t term_id)
+  {
+    for (auto &doc : this->postings[term_id])
+      bits[doc / 64] |= uint64_t(1) << (doc % 64);
+  };
+
+  // terms starting with the word
+  bool found = false;
+
+  for (auto it = this->term_ids.lower_bound(word);
+       it != this->term_ids.end() && it->first.starts_with(word);
+       ++it)
+  {
+    found = found || !this->postings[it->second].empty();
+    set_documents(it->second);
+  }
+
+  if (found || word.size() < SEARCH_INDEX_FUZZY_MIN_LENGTH)
+    return;
+
+  // similar terms, by number of trigrams in common
+  std::vector<uint32_t>                  word_trigrams = helper_trigrams(word);
+  std::unordered_map<uint32_t, uint32_t> shared; // by term
+
+  for (auto &trigram : word_trigrams)
+  {
+    auto it = this->trigrams.find(trigram);
+    if (it != this->trigrams.end())
+      for (auto &term_id : it->second)
+        shared[term_id]++;
+  }
+
+  for (auto &[term_id, n] : shared)
+  {
+    // padded term, one trigram by character plus one (duplicates aside)
+    size_t n_term = this->terms[term_id].size() + 1;
+    float  similarity = float(n) / float(word_trigrams.size() + n_term - n);
+
+    if (similarity >= SEARCH_INDEX_FUZZY_THRESHOLD)
+      set_documents(term_id);
+  }
+}
+
+void SearchIndex::remove(const std::string &id)
+{
+  auto it = this->docs.find(id);
+  if (it == this->docs.end())
+    return;
+
+  uint32_t doc = it->second;
+
+  for (auto &term_id : this->doc_terms[doc])
+  {
+    std::vector<uint32_t> &posting = this->postings[term_id];
+    auto                   pos = std::lower_bound(posting.begin(), posting.end(), doc);
+
+    if (pos != posting.end() && *pos == doc)
+      posting.erase(pos);
+  }
+
+  this->doc_ids[doc].clear();
+  this->doc_terms[doc].clear();
+  this->free_docs.push_back(doc);
+  this->docs.erase(it);
+  this->dirty = true;
+}
+
+std::vector<std::string_view> SearchIndex::search(const std::string &text) const
+{
+  std::vector<std::string>      words = helper_split_words(text);
+  std::vector<std::string_view> ids;
+
+  if (words.empty() || this->doc_ids.empty())
+    return ids;
+
+  // documents matching all the words, one bit by document
+  size_t                n_blocks = (this->doc_ids.size() + 63) / 64;
+  std::vector<uint64_t> result(n_blocks, ~uint64_t(0));
+  std::vector<uint64_t> bits(n_blocks);
+
+  for (auto &word : words)
+  {
+    std::fill(bits.begin(), bits.end(), 0);
+    this->match_word(word, bits);
+
+    for (size_t k = 0; k < n_blocks; k++)
+      result[k] &= bits[k];
+  }
+
+  for (size_t k = 0; k < n_blocks; k++)
+    for (uint64_t b = result[k]; b; b &= b - 1)
+      ids.push_back(this->doc_ids[k * 64 + std::countr_zero(b)]);
+
+  return ids;
+}
+
+void SearchIndex::set_is_dirty(bool new_state) { this->dirty = new_state; }
+
+size_t SearchIndex::size() const { return this->docs.size(); }
+
+} // namespace qtd
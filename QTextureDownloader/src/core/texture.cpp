@@ -26,9 +26,65 @@ TextureRes helper_poly_haven_res_converter(const std::string &text)
     return TextureRes::RUNKNOWN;
 }
 
+// bit of a type/resolution pair in Texture::available
+uint16_t helper_texture_bit(const TextureType &texture_type,
+                            const TextureRes  &texture_res)
+{
+  return uint16_t(1) << (int(texture_type) * TEXTURE_RES_COUNT + int(texture_res));
+}
+
+// prefix of the JSON keys of a type, e.g. "diffuse_urls"
+std::string helper_texture_type_key(const TextureType &texture_type)
+{
+  switch (texture_type)
+  {
+  case TextureType::DIFFUSE:
+    return "diffuse";
+  case TextureType::NORMAL:
+    return "normal";
+  case TextureType::DISPLACEMENT:
+    return "displacement";
+  }
+
+  return "";
+}
+
+// adjust thumbnail resolution (replace width and height)
+std::string helper_poly_haven_thumbnail_url(const std::string &url)
+{
+  int w = QTD_CONFIG->widget.thumbnail_size.width();
+  int h = QTD_CONFIG->widget.thumbnail_size.height();
+
+  std::string out = std::regex_replace(url,
+                                       std::regex("width=\\d+"),
+                                       "width=" + std::to_string(w));
+  return std::regex_replace(out,
+                            std::regex("height=\\d+"),
+                            "height=" + std::to_string(h));
+}
+
 bool Texture::from_poly_haven(const std::string    &asset_id,
                               const nlohmann::json &json_asset_list)
 {
+  JsonFetcher    json_fetcher;
+  nlohmann::json j = json_fetcher.fetch_sync("https://api.polyhaven.com/files/" +
+                                             asset_id);
+
+  if (j.empty())
+  {
+    Logger::log()->error(
+        "Texture::from_poly_haven: files - JSON parse or download error, asset {}",
+        asset_id);
+    return false;
+  }
+
+  return this->from_poly_haven(asset_id, json_asset_list, j);
+}
+
+bool Texture::from_poly_haven(const std::string    &asset_id,
+                              const nlohmann::json &json_asset_list,
+                              const nlohmann::json &json_files)
+{
 
   Logger::log()->trace("Texture::from_poly_haven: {}", asset_id);
 
@@ -42,172 +98,171 @@ bool Texture::from_poly_haven(const std::string    &asset_id,
     return false;
   }
 
-  nlohmann::json j = json_asset_list[asset_id];
+  const nlohmann::json &j = json_asset_list.at(asset_id);
 
   this->source = "PolyHaven";
   this->id_from_source = asset_id;
+  this->fingerprint = poly_haven_fingerprint(j);
+  this->details = std::make_shared<TextureDetails>(); // rebuilt from scratch
 
   ret |= json_safe_get(j, "name", this->name);
   ret |= json_safe_get(j, "thumbnail_url", this->thumbnail_url);
-  ret |= json_safe_get(j, "tags", this->tags);
-
-  // adjust thumbnail resolution (replace width and height)
-  int w = QTD_CONFIG->widget.thumbnail_size.width();
-  int h = QTD_CONFIG->widget.thumbnail_size.height();
+  ret |= json_safe_get(j, "tags", this->get_details_for_edit().tags);
 
-  thumbnail_url = std::regex_replace(thumbnail_url,
-                                     std::regex("width=\\d+"),
-                                     "width=" + std::to_string(w));
-  thumbnail_url = std::regex_replace(thumbnail_url,
-                                     std::regex("height=\\d+"),
-                                     "height=" + std::to_string(h));
+  this->thumbnail_url = helper_poly_haven_thumbnail_url(this->thumbnail_url);
 
   // texture files
+  for (auto &[map, type] : {std::pair("Diffuse", TextureType::DIFFUSE),
+                            std::pair("nor_gl", TextureType::NORMAL),
+                            std::pair("Displacement", TextureType::DISPLACEMENT)})
   {
-    JsonFetcher    json_fetcher;
-    nlohmann::json j = json_fetcher.fetch_sync("https://api.polyhaven.com/files/" +
-                                               asset_id);
+    if (!json_files.contains(map))
+      continue;
 
-    if (j.empty())
+    for (auto &[key, value] : json_files[map].items())
     {
-      Logger::log()->error(
-          "Texture::from_poly_haven: files - JSON parse or download error, asset {}",
-          asset_id);
-      return false;
-    }
+      const nlohmann::json &png = value["png"];
 
-    if (j.contains("Diffuse"))
-    {
-      for (auto &[key, value] : j["Diffuse"].items())
-        this->diffuse_urls[key] = value["png"]["url"].get<std::string>();
+      this->set_texture_url(type, key, png["url"].get<std::string>());
+      this->set_texture_file_info(
+          type,
+          key,
+          TextureFileInfo{png.value("size", int64_t(0)), png.value("md5", "")});
     }
+  }
 
-    if (j.contains("nor_gl"))
-    {
-      for (auto &[key, value] : j["nor_gl"].items())
-        this->normal_urls[key] = value["png"]["url"].get<std::string>();
-    }
+  return ret;
+}
+
+void Texture::from_poly_haven(const std::string &asset_id, const PolyHavenAsset &asset)
+{
+  Logger::log()->trace("Texture::from_poly_haven: {}", asset_id);
 
-    if (j.contains("Displacement"))
+  this->source = "PolyHaven";
+  this->id_from_source = asset_id;
+  this->fingerprint = poly_haven_fingerprint(asset);
+  this->name = asset.name;
+  this->thumbnail_url = helper_poly_haven_thumbnail_url(asset.thumbnail_url);
+
+  // rebuilt from scratch
+  this->details = std::make_shared<TextureDetails>();
+  this->details->tags = asset.tags;
+}
+
+const TextureDetails &Texture::get_details() const
+{
+  if (!this->details)
+  {
+    this->details = std::make_shared<TextureDetails>();
+
+    // nothing to load for a texture not saved yet
+    if (this->store)
     {
-      for (auto &[key, value] : j["Displacement"].items())
-        this->displacement_urls[key] = value["png"]["url"].get<std::string>();
+      nlohmann::json json = json_from_cbor_file(this->store->dir + "/" + this->id +
+                                                ".cbor");
+      if (!json.is_discarded())
+        this->details->json_from(json, this->store->url_templates, this->id_from_source);
     }
   }
 
-  return ret;
+  return *this->details;
 }
 
-std::string Texture::get_id() const { return this->id; }
+TextureDetails &Texture::get_details_for_edit()
+{
+  this->get_details();
+
+  // copy on write, the other copies of the texture are left unchanged
+  if (this->details.use_count() > 1)
+    this->details = std::make_shared<TextureDetails>(*this->details);
+
+  return *this->details;
+}
+
+const std::string &Texture::get_fingerprint() const { return this->fingerprint; }
+
+TextureDetailStore &Texture::get_store()
+{
+  if (!this->store)
+    this->store = std::make_shared<TextureDetailStore>();
+
+  return *this->store;
+}
+
+const std::string &Texture::get_id() const { return this->id; }
+
+const std::string &Texture::get_id_from_source() const { return this->id_from_source; }
 
 bool Texture::get_is_pinned() const { return this->is_pinned; }
 
-std::string Texture::get_name() const { return this->name; }
+const std::string &Texture::get_name() const { return this->name; }
 
-std::string Texture::get_source() const { return this->source; }
+const std::string &Texture::get_source() const { return this->source; }
 
 std::vector<TextureRes> Texture::get_texture_resolutions(
     const TextureType &texture_type) const
 {
-  std::vector<TextureRes>            out;
-  std::map<std::string, std::string> map;
+  std::vector<TextureRes> out;
 
-  switch (texture_type)
-  {
-  case TextureType::DIFFUSE:
-    map = this->diffuse_urls;
-    break;
-  case TextureType::NORMAL:
-    map = this->normal_urls;
-    break;
-  case TextureType::DISPLACEMENT:
-    map = this->displacement_urls;
-    break;
-  }
-
-  for (auto &[key, _] : map)
-  {
-    // convert text to resolution enum
-    TextureRes res = helper_poly_haven_res_converter(key);
-    if (res != TextureRes::RUNKNOWN)
+  for (auto &res : all_texture_res)
+    if (this->has_texture(texture_type, res))
       out.push_back(res);
-  }
 
   return out;
 }
 
+const TextureFileInfo &Texture::get_texture_file_info(
+    const TextureType &texture_type,
+    const TextureRes  &texture_res) const
+{
+  static const TextureFileInfo unknown;
+
+  if (!this->has_texture(texture_type, texture_res))
+    return unknown;
+
+  return this->get_details().infos[texture_type][texture_res];
+}
+
 std::string Texture::get_texture_url(const TextureType &texture_type,
                                      const TextureRes  &texture_res) const
 {
-  std::map<std::string, std::string> map;
-  std::string                        res_key;
+  if (!this->has_texture(texture_type, texture_res))
+    return "";
 
-  switch (texture_type)
-  {
-  case TextureType::DIFFUSE:
-    map = this->diffuse_urls;
-    break;
-  case TextureType::NORMAL:
-    map = this->normal_urls;
-    break;
-  case TextureType::DISPLACEMENT:
-    map = this->displacement_urls;
-    break;
-  }
+  // empty if the detail tier could not be loaded
+  int url_id = this->get_details().url_ids[texture_type][texture_res];
 
-  switch (texture_res)
-  {
-  case TextureRes::R1K:
-    res_key = "1k";
-    break;
-  case TextureRes::R2K:
-    res_key = "2k";
-    break;
-  case TextureRes::R4K:
-    res_key = "4k";
-    break;
-  case TextureRes::R8K:
-    res_key = "8k";
-    break;
-  case TextureRes::RUNKNOWN:
-    res_key = "?";
-  }
+  return this->store ? this->store->url_templates.expand(
+                           url_id,
+                           this->id_from_source,
+                           texture_res_as_string.at(texture_res))
+                     : "";
+}
 
-  return map.at(res_key);
+const std::vector<std::string> &Texture::get_tags() const
+{
+  return this->get_details().tags;
 }
 
-std::string Texture::get_thumbnail_url() const { return this->thumbnail_url; }
+const std::string &Texture::get_thumbnail_url() const { return this->thumbnail_url; }
 
 bool Texture::has_texture(const TextureType &texture_type) const
 {
-  switch (texture_type)
-  {
-  case TextureType::DIFFUSE:
-    return !this->diffuse_urls.empty();
-    break;
-  case TextureType::NORMAL:
-    return !this->normal_urls.empty();
-    break;
-  case TextureType::DISPLACEMENT:
-    return !this->displacement_urls.empty();
-    break;
-  }
-
-  return false;
+  uint16_t mask = (uint16_t(1) << TEXTURE_RES_COUNT) - 1;
+  return (this->available >> (int(texture_type) * TEXTURE_RES_COUNT)) & mask;
 }
 
 bool Texture::has_texture(const TextureType &texture_type,
                           const TextureRes  &texture_res) const
 {
-  // type first
-  if (!this->has_texture(texture_type))
+  if (texture_res == TextureRes::RUNKNOWN)
     return false;
 
-  // then check the resolution
-  std::vector<TextureRes> available_res = this->get_texture_resolutions(texture_type);
-  return contains(available_res, texture_res);
+  return this->available & helper_texture_bit(texture_type, texture_res);
 }
 
+bool Texture::is_details_loaded() const { return this->details != nullptr; }
+
 void Texture::json_from(nlohmann::json const &j)
 {
   json_safe_get(j, "id", id);
@@ -215,11 +270,44 @@ void Texture::json_from(nlohmann::json const &j)
   json_safe_get(j, "source", source);
   json_safe_get(j, "id_from_source", id_from_source);
   json_safe_get(j, "thumbnail_url", thumbnail_url);
-  json_safe_get(j, "tags", tags);
   json_safe_get(j, "is_pinned", is_pinned);
-  json_safe_get(j, "diffuse_urls", diffuse_urls);
-  json_safe_get(j, "normal_urls", normal_urls);
-  json_safe_get(j, "displacement_urls", displacement_urls);
+
+  // optional, missing in databases created before incremental updates
+  fingerprint = j.value("fingerprint", "");
+
+  // detail tier, stored along with the rest in catalogs of the previous versions
+  details.reset();
+
+  if (j.contains("diffuse_urls") || j.contains("tags"))
+  {
+    details = std::make_shared<TextureDetails>();
+    details->json_from(j, get_store().url_templates, id_from_source);
+  }
+
+  // available files (by type, e.g. {"Diffuse": ["1k", "2k"]}), derived from the urls
+  // for catalogs of the previous versions
+  available = 0;
+
+  if (details)
+  {
+    for (auto &type : all_texture_types)
+      for (auto &res : all_texture_res)
+        if (details->url_ids[type][res] >= 0)
+          available |= helper_texture_bit(type, res);
+  }
+  else
+  {
+    nlohmann::json resolutions = j.value("resolutions", nlohmann::json::object());
+
+    for (auto &type : all_texture_types)
+      for (auto &key : resolutions.value(texture_type_as_string.at(type),
+                                         std::vector<std::string>()))
+      {
+        TextureRes res = helper_poly_haven_res_converter(key);
+        if (res != TextureRes::RUNKNOWN)
+          available |= helper_texture_bit(type, res);
+      }
+  }
 }
 
 nlohmann::json Texture::json_to() const
@@ -231,17 +319,161 @@ nlohmann::json Texture::json_to() const
           {"source", source},
           {"id_from_source", id_from_source},
           {"thumbnail_url", thumbnail_url},
-          {"tags", tags},
+          {"fingerprint", fingerprint},
           {"is_pinned", is_pinned},
-          {"diffuse_urls", diffuse_urls},
-          {"normal_urls", normal_urls},
-          {"displacement_urls", displacement_urls}};
+          {"resolutions", nlohmann::json::object()}};
+
+  for (auto &type : all_texture_types)
+    for (auto &res : all_texture_res)
+      if (has_texture(type, res))
+        json["resolutions"][texture_type_as_string.at(type)].push_back(
+            texture_res_as_string.at(res));
 
   return json;
 }
 
+void Texture::release_details() { this->details.reset(); }
+
+void Texture::set_details_store(const std::shared_ptr<TextureDetailStore> &new_store)
+{
+  if (this->details && this->store && this->store != new_store)
+  {
+    TextureDetails &d = this->get_details_for_edit();
+
+    for (auto &type : all_texture_types)
+      for (auto &res : all_texture_res)
+      {
+        int &url_id = d.url_ids[type][res];
+
+        if (url_id < 0)
+          continue;
+
+        const std::string &res_key = texture_res_as_string.at(res);
+        std::string url = this->store->url_templates.expand(url_id,
+                                                            this->id_from_source,
+                                                            res_key);
+
+        url_id = new_store->url_templates.intern(url, this->id_from_source, res_key);
+      }
+  }
+
+  this->store = new_store;
+}
+
 void Texture::set_id(const std::string &new_id) { this->id = new_id; }
 
 void Texture::set_is_pinned(bool new_state) { this->is_pinned = new_state; }
 
+void Texture::set_texture_file_info(const TextureType     &texture_type,
+                                    const std::string     &res_key,
+                                    const TextureFileInfo &info)
+{
+  TextureRes res = helper_poly_haven_res_converter(res_key);
+
+  if (res != TextureRes::RUNKNOWN)
+    this->get_details_for_edit().infos[texture_type][res] = info;
+}
+
+void Texture::set_texture_url(const TextureType &texture_type,
+                              const std::string &res_key,
+                              const std::string &url)
+{
+  // resolutions not handled are dropped
+  TextureRes res = helper_poly_haven_res_converter(res_key);
+
+  if (res == TextureRes::RUNKNOWN)
+    return;
+
+  int url_id = this->get_store().url_templates.intern(url, this->id_from_source, res_key);
+
+  this->get_details_for_edit().url_ids[texture_type][res] = url_id;
+  this->available |= helper_texture_bit(texture_type, res);
+}
+
+TextureDetails::TextureDetails()
+{
+  for (auto &row : this->url_ids)
+    row.fill(-1);
+}
+
+void TextureDetails::json_from(nlohmann::json const &j,
+                               UrlTemplates         &url_templates,
+                               const std::string    &id_from_source)
+{
+  tags = j.value("tags", std::vector<std::string>());
+
+  // by type, e.g. {"diffuse_urls": {"1k": 0}, "diffuse_infos": {"1k": {...}}}, the
+  // infos being missing in databases created before integrity checks
+  for (auto &type : all_texture_types)
+  {
+    std::string key = helper_texture_type_key(type);
+
+    for (auto &[res_key, url] : j.value(key + "_urls", nlohmann::json::object()).items())
+    {
+      TextureRes res = helper_poly_haven_res_converter(res_key);
+
+      if (res == TextureRes::RUNKNOWN)
+        continue;
+
+      url_ids[type][res] = url.is_string() ? url_templates.intern(url.get<std::string>(),
+                                                                  id_from_source,
+                                                                  res_key)
+                                           : url.get<int>();
+    }
+
+    for (auto &[res_key, value] :
+         j.value(key + "_infos", nlohmann::json::object()).items())
+    {
+      TextureRes res = helper_poly_haven_res_converter(res_key);
+      if (res != TextureRes::RUNKNOWN)
+        infos[type][res] = TextureFileInfo{value.value("size", int64_t(0)),
+                                           value.value("md5", "")};
+    }
+  }
+}
+
+nlohmann::json TextureDetails::json_to() const
+{
+  nlohmann::json json = {{"tags", tags}};
+
+  for (auto &type : all_texture_types)
+  {
+    std::string key = helper_texture_type_key(type);
+
+    json[key + "_urls"] = nlohmann::json::object();
+    json[key + "_infos"] = nlohmann::json::object();
+
+    for (auto &res : all_texture_res)
+    {
+      if (url_ids[type][res] < 0)
+        continue;
+
+      const std::string     &res_key = texture_res_as_string.at(res);
+      const TextureFileInfo &info = infos[type][res];
+
+      json[key + "_urls"][res_key] = url_ids[type][res];
+      json[key + "_infos"][res_key] = {{"size", info.size}, {"md5", info.md5}};
+    }
+  }
+
+  return json;
+}
+
+std::string poly_haven_fingerprint(const nlohmann::json &json_asset)
+{
+  // same fields as the asset list parser, for both to fingerprint an asset alike
+  PolyHavenAsset asset;
+
+  asset.name = json_asset.value("name", "");
+  asset.thumbnail_url = json_asset.value("thumbnail_url", "");
+  asset.files_hash = json_asset.value("files_hash", "");
+  asset.date_published = json_asset.value("date_published", int64_t(0));
+
+  for (auto &tag : json_asset.value("tags", nlohmann::json::array()))
+    if (tag.is_string())
+      asset.tags.push_back(tag.get<std::string>());
+
+  return poly_haven_fingerprint(asset);
+}
+
 } // namespace qtd
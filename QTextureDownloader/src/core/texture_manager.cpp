@@ -1,20 +1,36 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
 #include <QApplication>
+#include <QFile>
 #include <QSettings>
+#include <QTimer>
 
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
+#include <fstream>
 
 #include "qtd/config.hpp"
+#include "qtd/download_scheduler.hpp"
+#include "qtd/http_cache.hpp"
 #include "qtd/image_fetcher.hpp"
 #include "qtd/json_fetcher.hpp"
 #include "qtd/logger.hpp"
+#include "qtd/mirror.hpp"
+#include "qtd/poly_haven_sax.hpp"
 #include "qtd/texture_manager.hpp"
 #include "qtd/utils.hpp"
 
 namespace qtd
 {
 
+// journal records before the catalog is compacted
+constexpr int TEXTURE_MANAGER_JOURNAL_MAX_RECORDS = 256;
+
+// disk budget reserved for a texture file of unknown size, its download is aborted
+// beyond that
+constexpr int64_t TEXTURE_MANAGER_UNKNOWN_SIZE_RESERVATION = 256 * 1024 * 1024;
+
 TextureManager::TextureManager(const std::string &storage_path_)
 {
   Logger::log()->trace("TextureManager::TextureManager");
@@ -44,27 +60,280 @@ TextureManager::TextureManager(const std::string &storage_path_)
                         dir.string());
     std::filesystem::create_directories(dir);
   }
+
+  if (QTD_CONFIG->storage.content_addressed)
+    this->content_store = ContentStore(this->storage_path);
+
+  if (QTD_CONFIG->storage.sqlite)
+    this->catalog_db = CatalogDb(this->storage_path + "/db.sqlite");
+
+  this->set_details_store();
+}
+
+// texture key as a string, for lookups: no allocation once the buffer is large enough,
+// valid until the next call
+std::string_view helper_key_view(const TextureKey &texture_key)
+{
+  thread_local std::string buffer;
+  return texture_key.to_string(buffer);
+}
+
+// records of 'fname' moved to the end of 'dst_fname'
+bool helper_append_journal(const std::string &fname, const std::string &dst_fname)
+{
+  std::error_code ec;
+
+  if (!std::filesystem::exists(fname))
+    return true;
+
+  if (!std::filesystem::exists(dst_fname))
+  {
+    std::filesystem::rename(fname, dst_fname, ec);
+    return !ec;
+  }
+
+  QFile src(QString::fromStdString(fname));
+  QFile dst(QString::fromStdString(dst_fname));
+
+  if (!src.open(QIODevice::ReadOnly) ||
+      !dst.open(QIODevice::WriteOnly | QIODevice::Append))
+    return false;
+
+  QByteArray data = src.readAll();
+
+  // last record of the old journal possibly cut by a crash
+  if (dst.size() > 0)
+    data.prepend('\n');
+
+  if (dst.write(data) != data.size() || !dst.flush())
+    return false;
+
+  src.close();
+  dst.close();
+
+  // records written twice are harmless if removing fails, they are replayed in order
+  std::filesystem::remove(fname, ec);
+  return true;
+}
+
+// disk budget reserved for a download, see TextureManager::reserve_storage
+int64_t helper_reserved_bytes(const FileCheck &check)
+{
+  return check.size > 0 ? check.size : check.max_size;
+}
+
+int64_t helper_now()
+{
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+int64_t helper_file_mtime(const std::string &fname)
+{
+  std::error_code ec;
+  auto            time = std::filesystem::last_write_time(fname, ec);
+  return ec ? 0 : int64_t(time.time_since_epoch().count());
 }
 
 bool TextureManager::is_empty() const { return this->textures.size() == 0; }
 
+bool TextureManager::is_texture_file_valid(const TextureKey  &texture_key,
+                                           const std::string &fname) const
+{
+  std::error_code ec;
+  int64_t         size = int64_t(std::filesystem::file_size(fname, ec));
+
+  if (ec)
+    return false;
+
+  auto it = this->textures.find(texture_key.id);
+  if (it == this->textures.end())
+    return true;
+
+  TextureFileInfo info = it->second.get_texture_file_info(texture_key.type,
+                                                          texture_key.res);
+
+  if (info.size > 0 && size != info.size)
+  {
+    Logger::log()->warn("TextureManager::is_texture_file_valid: size mismatch: {}",
+                        texture_key.to_string());
+    return false;
+  }
+
+  // the MD5 can only be compared for files downloaded and recorded, files from older
+  // versions are checked by size only
+  auto rec = this->file_records.find(helper_key_view(texture_key));
+
+  if (info.md5.empty() || rec == this->file_records.end() || rec->second.md5.empty() ||
+      rec->second.size != size || rec->second.mtime != helper_file_mtime(fname))
+    return true;
+
+  if (rec->second.md5 != info.md5)
+  {
+    Logger::log()->warn("TextureManager::is_texture_file_valid: modified upstream: {}",
+                        texture_key.to_string());
+    return false;
+  }
+
+  return true;
+}
+
+bool TextureManager::is_update_on_hold(const std::string &tex_id) const
+{
+  auto it = this->update_failures.find(tex_id);
+  if (it == this->update_failures.end())
+    return false;
+
+  // exponential backoff
+  int64_t delay = QTD_CONFIG->update.failure_backoff_s;
+  int64_t delay_max = QTD_CONFIG->update.failure_backoff_max_s;
+
+  for (int k = 1; k < it->second.count && delay < delay_max; k++)
+    delay *= 2;
+  delay = std::min(delay, delay_max);
+
+  int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+
+  return now < it->second.last_attempt + delay;
+}
+
+void TextureManager::append_journal(const nlohmann::json &record)
+{
+  QFile file(QString::fromStdString(this->storage_path + "/db.journal"));
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+  {
+    // not lost, written with the whole catalog at the next save
+    Logger::log()->error("TextureManager::append_journal: could not open journal");
+    this->catalog_dirty = true;
+    return;
+  }
+
+  file.write(QByteArray::fromStdString(record.dump() + "\n"));
+  file.close();
+
+  if (++this->journal_records >= TEXTURE_MANAGER_JOURNAL_MAX_RECORDS)
+    this->compact_journal();
+}
+
+std::string TextureManager::add_downloaded_texture(const TextureKey  &texture_key,
+                                                   const std::string &download_path)
+{
+  if (this->content_store.is_enabled())
+    return this->content_store.ingest(texture_key.to_string(), download_path);
+  else
+    return download_path;
+}
+
+void TextureManager::check_compaction()
+{
+  if (!this->compaction.valid() ||
+      this->compaction.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    return;
+
+  // the rotated journal is obsolete once the catalog is written, a failed compaction
+  // is done again at the next save
+  if (this->compaction.get())
+  {
+    std::error_code ec;
+    std::filesystem::remove(this->storage_path + "/db.journal.old", ec);
+  }
+  else
+  {
+    this->catalog_dirty = true;
+  }
+}
+
+void TextureManager::compact_journal()
+{
+  this->check_compaction();
+
+  std::string db_path = this->storage_path + "/db.cbor";
+  std::string journal_path = this->storage_path + "/db.journal";
+  std::string old_path = journal_path + ".old";
+
+  // the catalog cannot refer to details not written yet
+  this->save_details();
+
+  // the records appended while the catalog is written go to a new journal, the
+  // current one is kept until the catalog is written (and replayed at load otherwise).
+  // The '.old' journal of a failed compaction is not written yet either, it is kept
+  if (!helper_append_journal(journal_path, old_path))
+  {
+    Logger::log()->error("TextureManager::compact_journal: could not rotate journal");
+    return;
+  }
+
+  Logger::log()->trace("TextureManager::compact_journal: {} record(s)",
+                       this->journal_records);
+
+  this->journal_records = 0;
+  this->catalog_dirty = false;
+
+  // snapshot taken now, serialized and written in the background, after the
+  // compaction still in progress if any (see check_compaction)
+  this->compaction = std::async(std::launch::async,
+                                [previous = std::move(this->compaction),
+                                 json = this->json_to(),
+                                 db_path]()
+                                {
+                                  if (previous.valid())
+                                    previous.wait();
+
+                                  return json_to_cbor_file(json, db_path);
+                                });
+}
+
 void TextureManager::file_from(const std::string &fname)
 {
-  nlohmann::json json = json_from_file(fname);
+  nlohmann::json json = fname.ends_with(".cbor") ? json_from_cbor_file(fname)
+                                                 : json_from_file(fname);
+
+  if (json.is_discarded())
+    json = nlohmann::json();
+
   this->json_from(json);
 }
 
-void TextureManager::file_to(const std::string &fname) const
+bool TextureManager::file_to(const std::string &fname) const
 {
+  if (fname.ends_with(".cbor"))
+    return json_to_cbor_file(this->json_to(), fname);
+
   json_to_file(this->json_to(), fname);
+  return true;
+}
+
+std::string TextureManager::get_details_path(const std::string &tex_id) const
+{
+  return this->details_store->dir + "/" + tex_id + ".cbor";
+}
+
+std::string TextureManager::get_download_path(const TextureKey &texture_key) const
+{
+  // always downloaded to its plain location, then moved to the store if needed
+  return this->storage_path + "/" + texture_key.to_string() + ".png";
 }
 
 std::string TextureManager::get_storage_path() const { return this->storage_path; }
 
-std::map<std::string, Texture> &TextureManager::get_textures() { return this->textures; }
+const Texture *TextureManager::get_texture(std::string_view tex_id) const
+{
+  auto it = this->textures.find(tex_id);
+  return it == this->textures.end() ? nullptr : &it->second;
+}
+
+TextureMap &TextureManager::get_textures() { return this->textures; }
 
 std::string TextureManager::get_texture_path(const TextureKey &texture_key) const
 {
+  // resolved through the index for content-addressed storage
+  if (this->content_store.contains(helper_key_view(texture_key)))
+    return this->content_store.get_path(helper_key_view(texture_key));
+
   return this->storage_path + "/" + texture_key.to_string() + ".png";
 }
 
@@ -80,7 +349,12 @@ void TextureManager::json_from(nlohmann::json const &j)
   for (auto &[key, value] : j.items())
   {
     this->textures[key] = Texture();
+    this->textures[key].set_details_store(this->details_store);
     this->textures[key].json_from(value);
+
+    // catalog of the previous versions, details to be moved to their own files
+    if (this->textures[key].is_details_loaded())
+      this->details_dirty.insert(key);
   }
 }
 
@@ -94,115 +368,1012 @@ nlohmann::json TextureManager::json_to() const
   return json;
 }
 
-void TextureManager::load() { this->file_from(this->storage_path + "/db.json"); }
+void TextureManager::load()
+{
+  // binary catalog, or the JSON one of the previous versions, migrated once loaded
+  std::string db_path = this->storage_path + "/db.cbor";
+  std::string db_json_path = this->storage_path + "/db.json";
 
-void TextureManager::save() const
+  if (std::filesystem::exists(db_path))
+  {
+    this->file_from(db_path);
+  }
+  else if (!std::filesystem::exists(db_json_path))
+  {
+    // new storage
+    this->json_from(nlohmann::json::object());
+  }
+  else
+  {
+    this->file_from(db_json_path);
+    this->save_details();
+
+    std::error_code ec;
+
+    if (json_to_cbor_file(this->json_to(), db_path))
+      std::filesystem::rename(db_json_path, db_json_path + ".bak", ec);
+
+    Logger::log()->info("TextureManager::load: catalog migrated to {}", db_path);
+  }
+
+  // changes made after the catalog was last written, an '.old' journal being left by
+  // an interrupted compaction
+  std::string journal_path = this->storage_path + "/db.journal";
+
+  this->catalog_dirty = std::filesystem::exists(journal_path + ".old") ||
+                        !this->details_dirty.empty();
+  this->replay_journal(journal_path + ".old");
+  this->journal_records = this->replay_journal(journal_path);
+
+  this->load_search_index();
+
+  // content-addressed storage, texture files downloaded beforehand are moved to the
+  // store (thumbnails are left as is)
+  if (this->content_store.is_enabled())
+  {
+    this->content_store.load();
+    this->content_store.import_directory(this->storage_path,
+                                         ".png",
+                                         [](const std::string &name)
+                                         { return !name.ends_with("_thumbnail"); });
+    this->content_store.save();
+  }
+
+  // update failures
+  this->update_failures.clear();
+
+  std::string fname = this->storage_path + "/update_failures.json";
+
+  if (std::filesystem::exists(fname))
+    for (auto &[key, value] : json_from_file(fname).items())
+    {
+      this->update_failures[key].count = value.value("count", 0);
+      this->update_failures[key].last_attempt = value.value("last_attempt", int64_t(0));
+    }
+
+  this->failures_dirty = false;
+
+  // downloaded files records
+  this->file_records.clear();
+
+  fname = this->storage_path + "/file_records.json";
+
+  if (std::filesystem::exists(fname))
+    for (auto &[key, value] : json_from_file(fname).items())
+    {
+      this->file_records[key].id = value.value("id", "");
+      this->file_records[key].size = value.value("size", int64_t(0));
+      this->file_records[key].mtime = value.value("mtime", int64_t(0));
+      this->file_records[key].last_access = value.value("last_access", int64_t(0));
+      this->file_records[key].md5 = value.value("md5", "");
+    }
+
+  this->records_dirty = false;
+
+  // everything on disk has to be accounted for to enforce the disk budget
+  if (QTD_CONFIG->storage.max_bytes > 0)
+  {
+    this->scan_texture_files();
+    this->make_room(0);
+  }
+
+  // only the changes since the last session are written to the SQLite catalog
+  if (QTD_CONFIG->storage.sqlite && this->catalog_db.open())
+    this->update_catalog_db();
+}
+
+void TextureManager::load_search_index()
+{
+  std::string fname = this->storage_path + "/search_index.cbor";
+
+  if (std::filesystem::exists(fname))
+    this->search_index.json_from(json_from_cbor_file(fname));
+  else
+    this->search_index = SearchIndex();
+
+  // catalog modified behind the index (previous versions, interrupted session)
+  for (auto &id : this->search_index.get_ids())
+    if (!this->textures.contains(id))
+      this->search_index.remove(id);
+
+  for (auto &[id, tex] : this->textures)
+    if (!this->search_index.contains(id))
+    {
+      this->search_index.add(id, tex);
+
+      // details loaded only to be indexed
+      if (!this->details_dirty.contains(id))
+        tex.release_details();
+    }
+
+  Logger::log()->trace("TextureManager::load_search_index: {} texture(s)",
+                       this->search_index.size());
+}
+
+int64_t TextureManager::make_room(int64_t bytes)
+{
+  int64_t max_bytes = QTD_CONFIG->storage.max_bytes;
+
+  if (max_bytes <= 0)
+    return -1;
+
+  // least recently used first
+  std::vector<std::pair<int64_t, std::string>> candidates; // (last access, key)
+  int64_t                                      used = this->reserved_bytes;
+  std::set<std::string>                        objects; // deduplicated contents
+
+  for (auto &[key, rec] : this->file_records)
+  {
+    // contents shared by several files (content-addressed storage) count once
+    if (!this->content_store.contains(key) ||
+        objects.insert(this->content_store.get_path(key)).second)
+      used += rec.size;
+
+    auto it = this->textures.find(rec.id);
+    if (it == this->textures.end() || !it->second.get_is_pinned())
+      candidates.push_back({rec.last_access, key});
+  }
+
+  std::sort(candidates.begin(), candidates.end());
+
+  int n_evicted = 0;
+
+  for (size_t k = 0; k < candidates.size() && used + bytes > max_bytes; k++)
+  {
+    const std::string &key = candidates[k].second;
+    std::error_code    ec;
+
+    // nothing freed while a stored content is still used by another file
+    if (this->content_store.contains(key))
+    {
+      used -= this->content_store.remove(key);
+    }
+    else
+    {
+      std::filesystem::remove(this->storage_path + "/" + key + ".png", ec);
+      used -= this->file_records.at(key).size;
+    }
+
+    this->catalog_db.set_file_state(key, "", false);
+
+    this->file_records.erase(key);
+    this->records_dirty = true;
+    n_evicted++;
+  }
+
+  if (n_evicted)
+    Logger::log()->info("TextureManager::make_room: {} file(s) evicted, {} MB used",
+                        n_evicted,
+                        used / (1024 * 1024));
+
+  if (used + bytes > max_bytes)
+    Logger::log()->warn("TextureManager::make_room: disk budget exceeded by pinned "
+                        "textures or downloads in progress");
+
+  return std::max(int64_t(0), max_bytes - used);
+}
+
+int TextureManager::populate_mirror(const std::string &mirror_dir) const
+{
+  Logger::log()->trace("TextureManager::populate_mirror: {}", mirror_dir);
+
+  Mirror mirror(mirror_dir);
+  int    count = 0;
+
+  if (!mirror.is_local())
+  {
+    Logger::log()->error("TextureManager::populate_mirror: not a local directory: {}",
+                         mirror_dir);
+    return 0;
+  }
+
+  for (auto &[id, tex] : this->textures)
+  {
+    for (auto type : all_texture_types)
+      for (auto res : tex.get_texture_resolutions(type))
+      {
+        std::string fname = this->get_texture_path({id, type, res});
+
+        if (std::filesystem::exists(fname) &&
+            mirror.add_file(tex.get_texture_url(type, res), fname))
+          count++;
+      }
+
+    std::string fname = this->get_thumbnail_path(id);
+
+    if (std::filesystem::exists(fname) &&
+        mirror.add_file(tex.get_thumbnail_url(), fname))
+      count++;
+  }
+
+  // JSON documents (asset list, asset files...)
+  HttpCache http_cache(this->storage_path + "/cache");
+
+  for (auto &url : http_cache.get_urls())
+  {
+    QByteArray data;
+    if (http_cache.load_raw(url, data) && mirror.add_data(url, data))
+      count++;
+  }
+
+  Logger::log()->info("TextureManager::populate_mirror: {} file(s) mirrored", count);
+
+  return count;
+}
+
+std::vector<std::string> TextureManager::query_textures(const CatalogQuery &query) const
+{
+  if (this->catalog_db.is_open())
+    return this->catalog_db.query(query);
+
+  // same filters, by scanning the whole catalog
+  std::vector<std::string> ids;
+
+  for (auto &[id, tex] : this->textures)
+  {
+    if ((!query.source.empty() && tex.get_source() != query.source) ||
+        (query.is_pinned >= 0 && tex.get_is_pinned() != bool(query.is_pinned)) ||
+        (!query.tag.empty() && !contains(tex.get_tags(), query.tag)))
+      continue;
+
+    bool match = true;
+
+    for (auto &type : query.types)
+    {
+      bool found = false;
+
+      for (auto &res : all_texture_res)
+      {
+        if ((query.res != TextureRes::RUNKNOWN && res != query.res) ||
+            !tex.has_texture(type, res))
+          continue;
+
+        found = found || !query.downloaded ||
+                this->file_records.contains(helper_key_view({id, type, res}));
+      }
+
+      match = match && found;
+    }
+
+    if (match)
+      ids.push_back(id);
+  }
+
+  return ids;
+}
+
+void TextureManager::record_texture_file(const TextureKey  &texture_key,
+                                         const std::string &fname)
+{
+  std::error_code ec;
+  int64_t         size = int64_t(std::filesystem::file_size(fname, ec));
+
+  if (ec)
+    return;
+
+  FileRecord &rec = this->file_records[texture_key.to_string()];
+  rec.id = texture_key.id;
+  rec.size = size;
+  rec.mtime = helper_file_mtime(fname);
+  rec.last_access = helper_now();
+
+  // the asset may have been removed while the file was downloaded (update, purge), the
+  // file is still accounted for but cannot be checked against its MD5
+  auto it = this->textures.find(texture_key.id);
+
+  rec.md5 = it == this->textures.end()
+                ? ""
+                : it->second.get_texture_file_info(texture_key.type, texture_key.res).md5;
+
+  this->catalog_db.set_file_state(texture_key.to_string(), fname, true);
+  this->records_dirty = true;
+}
+
+bool TextureManager::reserve_storage(const TextureKey &texture_key, FileCheck &check)
+{
+  TextureFileInfo info = this->textures.at(texture_key.id)
+                             .get_texture_file_info(texture_key.type, texture_key.res);
+
+  check = FileCheck{info.size, info.md5};
+
+  // known size checked right away, unknown size against the length announced by the
+  // server (see FileCheck::max_size). The latter are given a bounded share of the
+  // budget, so that concurrent downloads cannot each count on all of it
+  int64_t available = this->make_room(
+      info.size > 0 ? info.size : TEXTURE_MANAGER_UNKNOWN_SIZE_RESERVATION);
+
+  if (available >= 0)
+  {
+    if (available == 0 || info.size > available)
+    {
+      Logger::log()->error(
+          "TextureManager::reserve_storage: not enough disk budget for {}",
+          texture_key.to_string());
+      return false;
+    }
+
+    check.max_size = info.size > 0
+                         ? available
+                         : std::min(available, TEXTURE_MANAGER_UNKNOWN_SIZE_RESERVATION);
+  }
+
+  // released once the download is done (see release_storage)
+  this->reserved_bytes += helper_reserved_bytes(check);
+  return true;
+}
+
+void TextureManager::release_storage(const FileCheck &check)
+{
+  this->reserved_bytes -= helper_reserved_bytes(check);
+}
+
+int TextureManager::replay_journal(const std::string &fname)
+{
+  std::ifstream file(fname);
+  std::string   line;
+  int           count = 0;
+
+  while (std::getline(file, line))
+  {
+    if (line.empty())
+      continue;
+
+    nlohmann::json record = nlohmann::json::parse(line, nullptr, false);
+
+    // last record cut by a crash
+    if (record.is_discarded() || !record.is_object())
+    {
+      Logger::log()->warn("TextureManager::replay_journal: invalid record in {}", fname);
+      continue;
+    }
+
+    std::string op = record.value("op", "");
+    auto        it = this->textures.find(record.value("id", ""));
+
+    if (op == "pin" && it != this->textures.end())
+      it->second.set_is_pinned(record.value("value", false));
+
+    count++;
+  }
+
+  if (count)
+    Logger::log()->trace("TextureManager::replay_journal: {} record(s) from {}",
+                         count,
+                         fname);
+
+  return count;
+}
+
+void TextureManager::retrieve_material(const std::string              &id,
+                                       const std::vector<TextureType> &types,
+                                       const TextureRes               &res,
+                                       MaterialResult::Callback        callback,
+                                       DownloadProgressCallback        progress_callback,
+                                       bool                            force_download,
+                                       DownloadPriority                priority)
+{
+  Logger::log()->trace("TextureManager::retrieve_material: {}", id);
+
+  // shared by the transfers of the material
+  struct MaterialJob
+  {
+    MaterialResult                                     result;
+    size_t                                             remaining = 0;
+    bool                                               failed = false;
+    std::map<TextureType, std::pair<int64_t, int64_t>> progress; // received, total
+  };
+
+  auto job = std::make_shared<MaterialJob>();
+  job->result.id = id;
+  job->result.res = res;
+
+  auto release = [job, callback]()
+  {
+    if (--job->remaining == 0)
+    {
+      job->result.complete = !job->failed;
+      callback(job->result);
+    }
+  };
+
+  auto map_done = [job, release](const TextureType &type, const std::string &path)
+  {
+    if (path.empty())
+      job->failed = true;
+    else
+      job->result.paths[type] = path;
+
+    release();
+  };
+
+  auto report_progress = [job, progress_callback]()
+  {
+    int64_t received = 0;
+    int64_t total = 0;
+
+    for (auto &[type, p] : job->progress)
+    {
+      received += p.first;
+      total = (total < 0 || p.second < 0) ? -1 : total + p.second;
+    }
+
+    progress_callback(received, total);
+  };
+
+  DownloadScheduler *scheduler = DownloadScheduler::get_scheduler();
+  auto               it = this->textures.find(id);
+
+  // one more reference, released last, so that the material cannot be completed
+  // before all its maps are submitted
+  job->remaining = types.size() + 1;
+
+  for (auto &type : types)
+  {
+    TextureKey key(id, type, res);
+
+    if (it == this->textures.end() || !it->second.has_texture(type, res))
+    {
+      Logger::log()->error("TextureManager::retrieve_material: not available: {}",
+                           key.to_string());
+      map_done(type, "");
+      continue;
+    }
+
+    std::string fname = this->get_texture_path(key);
+
+    if (!force_download && this->is_texture_file_valid(key, fname))
+    {
+      this->touch_texture_file(key);
+      map_done(type, fname);
+      continue;
+    }
+
+    FileCheck check;
+
+    if (!this->reserve_storage(key, check))
+    {
+      map_done(type, "");
+      continue;
+    }
+
+    std::string url = it->second.get_texture_url(type, res);
+    std::string download_path = this->get_download_path(key);
+
+    Logger::log()->trace("TextureManager::retrieve_material: downloading {}", url);
+
+    DownloadProgressCallback map_progress = nullptr;
+
+    if (progress_callback)
+    {
+      job->progress[type] = {0, -1};
+      map_progress = [job, type, report_progress](int64_t received, int64_t total)
+      {
+        job->progress[type] = {received, total};
+        report_progress();
+      };
+    }
+
+    scheduler->submit_file(
+        url,
+        download_path,
+        priority,
+        [this, key, download_path, check, map_done](bool ok)
+        {
+          std::string path = ok ? this->add_downloaded_texture(key, download_path) : "";
+
+          this->release_storage(check);
+
+          if (!path.empty())
+          {
+            this->record_texture_file(key, path);
+            this->make_room(0); // in case the size was not known beforehand
+          }
+
+          map_done(key.type, path);
+        },
+        map_progress,
+        check);
+  }
+
+  // completed asynchronously even if all the maps are already there, like a transfer
+  QTimer::singleShot(0, QCoreApplication::instance(), release);
+}
+
+void TextureManager::save()
 {
   QSettings settings("olink", "QTextureDownloader");
   settings.setValue("storage_path", this->storage_path.c_str());
 
-  this->file_to(this->storage_path + "/db.json");
+  this->check_compaction();
+  this->save_details();
+
+  if (this->catalog_dirty && this->compaction.valid())
+  {
+    // a compaction in progress must not overwrite what is about to be written, the
+    // catalog is then written in the background after it
+    this->compact_journal();
+  }
+  else if (this->catalog_dirty && this->file_to(this->storage_path + "/db.cbor"))
+  {
+    // the journal is obsolete once the whole catalog is written
+    std::error_code ec;
+    std::filesystem::remove(this->storage_path + "/db.journal", ec);
+    std::filesystem::remove(this->storage_path + "/db.journal.old", ec);
+
+    this->journal_records = 0;
+    this->catalog_dirty = false;
+  }
+
+  this->content_store.save();
+
+  if (this->failures_dirty)
+  {
+    nlohmann::json json = nlohmann::json::object();
+
+    for (auto &[key, failure] : this->update_failures)
+      json[key] = {{"count", failure.count}, {"last_attempt", failure.last_attempt}};
+
+    json_to_file(json, this->storage_path + "/update_failures.json");
+    this->failures_dirty = false;
+  }
+
+  if (this->records_dirty)
+  {
+    nlohmann::json json = nlohmann::json::object();
+
+    for (auto &[key, rec] : this->file_records)
+      json[key] = {{"id", rec.id},
+                   {"size", rec.size},
+                   {"mtime", rec.mtime},
+                   {"last_access", rec.last_access},
+                   {"md5", rec.md5}};
+
+    json_to_file(json, this->storage_path + "/file_records.json");
+    this->records_dirty = false;
+  }
+
+  if (this->search_index.is_dirty() &&
+      json_to_cbor_file(this->search_index.json_to(),
+                        this->storage_path + "/search_index.cbor"))
+    this->search_index.set_is_dirty(false);
+}
+
+void TextureManager::set_update_status(const std::string &tex_id, bool success)
+{
+  this->failures_dirty = true;
+
+  if (success)
+  {
+    this->update_failures.erase(tex_id);
+    return;
+  }
+
+  UpdateFailure &failure = this->update_failures[tex_id];
+  failure.count++;
+  failure.last_attempt = std::chrono::duration_cast<std::chrono::seconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+}
+
+void TextureManager::save_details()
+{
+  UrlTemplates &url_templates = this->details_store->url_templates;
+
+  if (this->details_dirty.empty() && !url_templates.is_dirty())
+    return;
+
+  std::error_code ec;
+  std::filesystem::create_directories(this->details_store->dir, ec);
+
+  // the details refer to the templates by index, templates first
+  if (url_templates.is_dirty())
+  {
+    if (!json_to_cbor_file(url_templates.json_to(),
+                           this->details_store->dir + "/url_templates.cbor"))
+      return;
+
+    url_templates.set_is_dirty(false);
+  }
+
+  std::set<std::string> failed;
+
+  for (auto &id : this->details_dirty)
+  {
+    auto it = this->textures.find(id);
+
+    if (it == this->textures.end())
+      continue;
+
+    // written details are dropped from memory, loaded again when needed
+    if (json_to_cbor_file(it->second.get_details().json_to(), this->get_details_path(id)))
+      it->second.release_details();
+    else
+      failed.insert(id);
+  }
+
+  Logger::log()->trace("TextureManager::save_details: {} texture(s)",
+                       this->details_dirty.size() - failed.size());
+
+  this->details_dirty = failed;
+}
+
+void TextureManager::scan_texture_files()
+{
+  this->records_dirty = true;
+
+  std::erase_if(this->file_records,
+                [this](const auto &pair)
+                {
+                  std::string fname = this->content_store.contains(pair.first)
+                                          ? this->content_store.get_path(pair.first)
+                                          : this->storage_path + "/" + pair.first +
+                                                ".png";
+                  return !std::filesystem::exists(fname);
+                });
+
+  // unknown files are considered the least recently used ones
+  for (auto &[id, tex] : this->textures)
+    for (auto &type : all_texture_types)
+      for (auto &res : tex.get_texture_resolutions(type))
+      {
+        TextureKey key(id, type, res);
+
+        if (this->file_records.contains(helper_key_view(key)))
+          continue;
+
+        std::string     fname = this->get_texture_path(key);
+        std::error_code ec;
+        int64_t         size = int64_t(std::filesystem::file_size(fname, ec));
+
+        if (!ec)
+          this->file_records[key.to_string()] = FileRecord{id,
+                                                           size,
+                                                           helper_file_mtime(fname),
+                                                           0,
+                                                           ""};
+      }
+}
+
+std::vector<std::string_view> TextureManager::search_textures(
+    const std::string &text) const
+{
+  return this->search_index.search(text);
+}
+
+void TextureManager::set_details_store()
+{
+  this->details_store = std::make_shared<TextureDetailStore>();
+  this->details_store->dir = this->storage_path + "/details";
+
+  std::string fname = this->details_store->dir + "/url_templates.cbor";
+
+  if (std::filesystem::exists(fname))
+    this->details_store->url_templates.json_from(json_from_cbor_file(fname));
+
+  for (auto &[id, tex] : this->textures)
+    tex.set_details_store(this->details_store);
+}
+
+void TextureManager::set_disk_budget(int64_t max_bytes)
+{
+  QTD_CONFIG->storage.max_bytes = max_bytes;
+
+  if (max_bytes > 0)
+  {
+    this->scan_texture_files();
+    this->make_room(0);
+  }
+}
+
+void TextureManager::set_is_pinned(const std::string &tex_id, bool new_state)
+{
+  auto it = this->textures.find(tex_id);
+  if (it == this->textures.end())
+    return;
+
+  it->second.set_is_pinned(new_state);
+  this->catalog_db.set_pinned(tex_id, new_state);
+
+  this->append_journal({{"op", "pin"}, {"id", tex_id}, {"value", new_state}});
 }
 
 void TextureManager::set_storage_path(const std::string &new_path)
 {
+  // a compaction in progress belongs to the previous storage
+  if (this->compaction.valid())
+    this->compaction.wait();
+
+  this->check_compaction();
+
+  // the details still on the previous storage are brought along
+  for (auto &[id, tex] : this->textures)
+  {
+    tex.get_details();
+    this->details_dirty.insert(id);
+  }
+
   this->storage_path = new_path;
+  this->set_details_store();
+  this->search_index.set_is_dirty(true);
+
+  if (QTD_CONFIG->storage.content_addressed)
+  {
+    this->content_store = ContentStore(this->storage_path);
+    this->content_store.load();
+  }
+
+  if (QTD_CONFIG->storage.sqlite)
+  {
+    this->catalog_db = CatalogDb(this->storage_path + "/db.sqlite");
+    this->catalog_db.open();
+  }
+
   this->update();
 }
 
 std::string TextureManager::try_download_texture(const TextureKey &texture_key,
-                                                 bool              force_download) const
+                                                 bool              force_download)
 {
-  if (!textures.contains(texture_key.id))
-    return "";
-
-  Texture tex = this->textures.at(texture_key.id);
+  const Texture *tex = this->get_texture(texture_key.id);
 
-  if (!tex.has_texture(texture_key.type, texture_key.res))
+  if (!tex || !tex->has_texture(texture_key.type, texture_key.res))
     return "";
 
   std::string fname = this->get_texture_path(texture_key);
 
-  // check if file exists and download it if not
-  std::filesystem::path path = std::filesystem::path(fname);
-
-  if (!std::filesystem::exists(path) || force_download)
+  // check if a valid file exists and download it if not (files are only moved to their
+  // final location once completely downloaded and checked, see download_file)
+  if (force_download || !this->is_texture_file_valid(texture_key, fname))
   {
-    std::string url = tex.get_texture_url(texture_key.type, texture_key.res);
+    FileCheck check;
+
+    if (!this->reserve_storage(texture_key, check))
+      return "";
+
+    std::string url = tex->get_texture_url(texture_key.type, texture_key.res);
 
     Logger::log()->trace("TextureManager::try_download_texture: downloading {}", url);
-    bool ok = download_file(url, fname);
+    std::string download_path = this->get_download_path(texture_key);
+
+    // an invalid file is replaced
+    bool ok = download_file(url,
+                            download_path,
+                            true,
+                            nullptr,
+                            DownloadPriority::USER,
+                            check);
+
+    this->release_storage(check);
 
     if (!ok)
       return "";
+
+    fname = this->add_downloaded_texture(texture_key, download_path);
+
+    if (!fname.empty())
+    {
+      this->record_texture_file(texture_key, fname);
+      this->make_room(0); // in case the size was not known beforehand
+    }
+  }
+  else
+  {
+    this->touch_texture_file(texture_key);
   }
 
   return fname;
 }
 
-void TextureManager::update()
+void TextureManager::touch_texture_file(const TextureKey &texture_key)
+{
+  auto it = this->file_records.find(helper_key_view(texture_key));
+  if (it != this->file_records.end())
+  {
+    it->second.last_access = helper_now();
+    this->records_dirty = true;
+  }
+}
+
+void TextureManager::update(bool force_full_update)
 {
   Logger::log()->trace("TextureManager::update");
-  this->update_from_poly_haven();
+  this->update_from_poly_haven(force_full_update || !QTD_CONFIG->update.incremental);
+  this->catalog_dirty = true;
+
+  if (this->catalog_db.is_open())
+    this->update_catalog_db();
 }
 
-void TextureManager::update_from_poly_haven()
+void TextureManager::update_catalog_db()
 {
-  Logger::log()->trace("TextureManager::update_from_poly_haven");
+  this->catalog_db.import_textures(this->textures);
+
+  // downloaded files, same locations as in scan_texture_files
+  std::map<std::string, std::string> paths;
+
+  for (auto &[name, rec] : this->file_records)
+    paths[name] = this->content_store.contains(name)
+                      ? this->content_store.get_path(name)
+                      : this->storage_path + "/" + name + ".png";
+
+  this->catalog_db.import_file_states(paths);
+}
+
+void TextureManager::update_from_poly_haven(bool full_update)
+{
+  Logger::log()->trace("TextureManager::update_from_poly_haven: full update: {}",
+                       full_update);
 
   // --- retrieve asset list
 
-  std::vector<std::string> asset_ids;
+  // JSON responses are cached and revalidated to avoid transferring and parsing
+  // unchanged documents again
+  HttpCache http_cache(this->storage_path + "/cache");
+
+  JsonFetcher json_fetcher;
+  json_fetcher.set_cache(http_cache);
 
-  JsonFetcher    json_fetcher;
-  nlohmann::json json_asset_list = json_fetcher.fetch_sync(
-      "https://api.polyhaven.com/assets?type=textures");
+  // the (large) asset list is parsed while it is received, only the fields used are
+  // kept, no JSON document is built
+  PolyHavenAssetListSax asset_list;
 
-  if (json_asset_list.empty())
+  if (!json_fetcher.fetch_sax("https://api.polyhaven.com/assets?type=textures",
+                              asset_list) ||
+      asset_list.assets.empty())
   {
     Logger::log()->error(
         "TextureManager::update_from_poly_haven: could not fetch asset list");
     return;
   }
 
-  for (auto &e : json_asset_list.items())
-    asset_ids.push_back(e.key());
+  const std::map<std::string, PolyHavenAsset> &assets = asset_list.assets;
 
-  // --- update textures data
+  // --- drop the assets removed upstream
 
-  int k = 0; // TODO DBG
+  size_t n_removed = std::erase_if(
+      this->textures,
+      [this, &assets](const auto &pair)
+      {
+        if (pair.second.get_source() != "PolyHaven" ||
+            assets.contains(pair.second.get_id_from_source()))
+          return false;
 
-  for (auto &source_id : asset_ids)
-  {
-    // build up a unique ID based on the source and the source ID
-    const std::string id = "PolyHaven_" + source_id;
+        std::error_code ec;
+        std::filesystem::remove(this->get_details_path(pair.first), ec);
+        this->details_dirty.erase(pair.first);
+        this->search_index.remove(pair.first);
+        return true;
+      });
 
-    Logger::log()->info("TextureManager::update_from_poly_haven: texture {}", id);
+  if (n_removed)
+    Logger::log()->info("TextureManager::update_from_poly_haven: {} asset(s) removed",
+                        n_removed);
 
-    // create and/or replace
-    Texture new_texture = Texture();
-    new_texture.set_id(id);
-    bool ok = new_texture.from_poly_haven(source_id, json_asset_list);
+  // failures of the assets removed upstream, including the ones never added
+  if (std::erase_if(this->update_failures,
+                    [&assets](const auto &pair)
+                    {
+                      return pair.first.starts_with("PolyHaven_") &&
+                             !assets.contains(pair.first.substr(10));
+                    }))
+    this->failures_dirty = true;
 
-    if (ok)
-      this->textures[id] = new_texture;
-    else
-      continue;
+  // --- update textures data: asset files are fetched concurrently and each texture is
+  // --- built as soon as its data are received, while the other requests are in flight
 
-    // download thumbnail
-    std::string url = this->textures.at(id).get_thumbnail_url();
+  DownloadScheduler *scheduler = DownloadScheduler::get_scheduler();
+  DownloadGroup      group;
+
+  auto enqueue_thumbnail = [this, scheduler, &group](const std::string &id,
+                                                      bool               overwrite)
+  {
     std::string fname = this->get_thumbnail_path(id);
 
+    if (!overwrite && std::filesystem::exists(fname))
+      return;
+
+    std::string url = this->textures.at(id).get_thumbnail_url();
+
     Logger::log()->trace(
         "TextureManager::update_from_poly_haven: downloading thumbnail {}",
         url);
-    ok = download_file(url, fname);
 
-    // TODO TEST
-    // k++;
-    // if (k > 8)
-    //   break;
+    scheduler->submit(url,
+                      DownloadPriority::BACKGROUND,
+                      group.track(
+                          [fname, overwrite](bool ok, const QByteArray &data)
+                          {
+                            if (ok)
+                              save_to_file(data, fname, overwrite);
+                          }));
+  };
+
+  int n_skipped = 0;
+  int n_on_hold = 0; // recent failures
+
+  for (auto &e : assets)
+  {
+    // build up a unique ID based on the source and the source ID
+    const std::string source_id = e.first;
+    const std::string id = "PolyHaven_" + source_id;
+
+    // unchanged assets, only retrieve the thumbnail if it is missing (and fetched again
+    // if their details were lost)
+    auto it = this->textures.find(id);
+
+    if (!full_update && it != this->textures.end() &&
+        it->second.get_fingerprint() == poly_haven_fingerprint(e.second) &&
+        (it->second.is_details_loaded() ||
+         std::filesystem::exists(this->get_details_path(id))))
+    {
+      enqueue_thumbnail(id, false);
+      n_skipped++;
+      continue;
+    }
+
+    if (!full_update && this->is_update_on_hold(id))
+    {
+      Logger::log()->trace(
+          "TextureManager::update_from_poly_haven: recent failure, skipping {}",
+          id);
+      n_on_hold++;
+      continue;
+    }
+
+    // base data now, the texture urls are filled by the files document handler
+    auto new_texture = std::make_shared<Texture>();
+    new_texture->set_id(id);
+    new_texture->set_details_store(this->details_store);
+    new_texture->from_poly_haven(source_id, e.second);
+
+    auto handler = std::make_shared<PolyHavenFilesSax>(*new_texture);
+
+    scheduler->submit_sax(
+        "https://api.polyhaven.com/files/" + source_id,
+        DownloadPriority::NORMAL,
+        handler,
+        group.track(
+            [this, &enqueue_thumbnail, new_texture, handler, source_id, id](bool ok)
+            {
+              Logger::log()->info("TextureManager::update_from_poly_haven: texture {}",
+                                  id);
+
+              if (!ok || handler->get_count() == 0)
+              {
+                Logger::log()->error(
+                    "TextureManager::update_from_poly_haven: files - JSON parse or "
+                    "download error, asset {}",
+                    source_id);
+                this->set_update_status(id, false);
+                return;
+              }
+
+              // create and/or replace, keeping the user data
+              bool is_new = !this->textures.contains(id);
+
+              if (!is_new)
+                new_texture->set_is_pinned(this->textures.at(id).get_is_pinned());
+
+              this->textures[id] = std::move(*new_texture);
+              this->details_dirty.insert(id);
+              this->search_index.add(id, this->textures.at(id));
+              this->set_update_status(id, true);
+
+              // the thumbnail may have changed for modified assets
+              enqueue_thumbnail(id, !is_new);
+            }),
+        http_cache);
   }
+
+  Logger::log()->info("TextureManager::update_from_poly_haven: {} asset(s) up to date",
+                      n_skipped);
+
+  if (n_on_hold)
+    Logger::log()->info(
+        "TextureManager::update_from_poly_haven: {} asset(s) on hold after a failure",
+        n_on_hold);
+
+  group.wait();
 }
 
 } // namespace qtd
@@ -0,0 +1,152 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <filesystem>
+
+#include <QBuffer>
+#include <QImageReader>
+#include <QPointer>
+
+#include "qtd/config.hpp"
+#include "qtd/download_scheduler.hpp"
+#include "qtd/logger.hpp"
+#include "qtd/thumbnail_loader.hpp"
+#include "qtd/utils.hpp"
+
+namespace qtd
+{
+
+// delivery period, the ready images are grouped in between
+constexpr int THUMBNAIL_LOADER_BATCH_MS = 50;
+
+QImage helper_read_thumbnail(QImageReader &reader, const QSize &target_size)
+{
+  // scaled while decoding when the format supports it, after otherwise, in both cases
+  // in the worker thread
+  QSize size = reader.size();
+  if (size.isValid() && target_size.isValid())
+    reader.setScaledSize(size.scaled(target_size, Qt::KeepAspectRatio));
+
+  return reader.read();
+}
+
+ThumbnailLoader::ThumbnailLoader(QObject *parent)
+    : QObject(parent), results(std::make_shared<Results>())
+{
+  this->flush_timer.setInterval(THUMBNAIL_LOADER_BATCH_MS);
+  this->connect(&this->flush_timer, &QTimer::timeout, this, [this]() { this->flush(); });
+}
+
+ThumbnailLoader::~ThumbnailLoader()
+{
+  this->thread_pool.clear();
+  this->thread_pool.waitForDone();
+}
+
+void ThumbnailLoader::cancel()
+{
+  this->thread_pool.clear(); // not started yet
+  this->results = std::make_shared<Results>();
+  this->flush_timer.stop();
+}
+
+void ThumbnailLoader::decode(const std::shared_ptr<Results> &target,
+                             const std::string              &id,
+                             const std::string              &file_path,
+                             const QByteArray               &data)
+{
+  QSize target_size = QTD_CONFIG->widget.thumbnail_size;
+
+  // from the data if already in memory, from the file otherwise
+  this->thread_pool.start(
+      [target, id, file_path, data, target_size]()
+      {
+        QImage image;
+
+        if (data.isEmpty())
+        {
+          QImageReader reader(QString::fromStdString(file_path));
+          image = helper_read_thumbnail(reader, target_size);
+        }
+        else
+        {
+          QBuffer buffer;
+          buffer.setData(data);
+          buffer.open(QIODevice::ReadOnly);
+
+          QImageReader reader(&buffer);
+          image = helper_read_thumbnail(reader, target_size);
+        }
+
+        std::lock_guard<std::mutex> lock(target->mutex);
+        target->pending--;
+
+        if (!image.isNull())
+          target->images.emplace_back(id, std::move(image));
+      });
+}
+
+void ThumbnailLoader::flush()
+{
+  ThumbnailBatch batch;
+  bool           done = false;
+
+  {
+    std::lock_guard<std::mutex> lock(this->results->mutex);
+    batch.swap(this->results->images);
+    done = this->results->pending == 0;
+  }
+
+  if (done)
+    this->flush_timer.stop();
+
+  if (!batch.empty())
+    Q_EMIT this->thumbnails_ready(batch);
+}
+
+void ThumbnailLoader::request(const std::string &id,
+                              const std::string &file_path,
+                              const std::string &url)
+{
+  bool exists = std::filesystem::exists(file_path);
+
+  if (!exists && url.empty())
+    return;
+
+  std::shared_ptr<Results> target = this->results;
+
+  {
+    std::lock_guard<std::mutex> lock(target->mutex);
+    target->pending++;
+  }
+
+  if (!this->flush_timer.isActive())
+    this->flush_timer.start();
+
+  if (exists)
+  {
+    this->decode(target, id, file_path, QByteArray());
+    return;
+  }
+
+  // fetched first, then decoded from memory. The loader may be gone in the meantime
+  QPointer<ThumbnailLoader> self(this);
+
+  DownloadScheduler::get_scheduler()->submit(
+      url,
+      DownloadPriority::BACKGROUND,
+      [self, target, id, file_path](bool ok, const QByteArray &data)
+      {
+        if (ok)
+          save_to_file(data, file_path);
+
+        if (ok && self && target == self->results)
+          self->decode(target, id, file_path, data);
+        else
+        {
+          std::lock_guard<std::mutex> lock(target->mutex);
+          target->pending--;
+        }
+      });
+}
+
+} // namespace qtd
@@ -0,0 +1,79 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include "qtd/logger.hpp"
+#include "qtd/url_templates.hpp"
+
+namespace qtd
+{
+
+void helper_replace_all(std::string       &text,
+                        const std::string &from,
+                        const std::string &to)
+{
+  if (from.empty())
+    return;
+
+  for (size_t pos = text.find(from); pos != std::string::npos;
+       pos = text.find(from, pos + to.size()))
+    text.replace(pos, from.size(), to);
+}
+
+std::string UrlTemplates::expand(int                index,
+                                 const std::string &id,
+                                 const std::string &res) const
+{
+  if (index < 0 || index >= int(this->templates.size()))
+    return "";
+
+  std::string url = this->templates[index];
+  helper_replace_all(url, "{id}", id);
+  helper_replace_all(url, "{res}", res);
+  return url;
+}
+
+int UrlTemplates::intern(const std::string &url,
+                         const std::string &id,
+                         const std::string &res)
+{
+  // ID first, the resolution may also appear in it
+  std::string tpl = url;
+  helper_replace_all(tpl, id, "{id}");
+  helper_replace_all(tpl, res, "{res}");
+
+  auto it = this->indices.find(tpl);
+  if (it != this->indices.end())
+    return it->second;
+
+  Logger::log()->trace("UrlTemplates::intern: new template {}", tpl);
+
+  this->templates.push_back(tpl);
+  this->indices[tpl] = int(this->templates.size()) - 1;
+  this->dirty = true;
+
+  return int(this->templates.size()) - 1;
+}
+
+bool UrlTemplates::is_dirty() const { return this->dirty; }
+
+void UrlTemplates::json_from(nlohmann::json const &json)
+{
+  this->templates.clear();
+  this->indices.clear();
+
+  if (json.is_array())
+    for (auto &tpl : json)
+    {
+      this->templates.push_back(tpl.get<std::string>());
+      this->indices[this->templates.back()] = int(this->templates.size()) - 1;
+    }
+
+  this->dirty = false;
+}
+
+nlohmann::json UrlTemplates::json_to() const { return this->templates; }
+
+void UrlTemplates::set_is_dirty(bool new_state) { this->dirty = new_state; }
+
+size_t UrlTemplates::size() const { return this->templates.size(); }
+
+} // namespace qtd
@@ -4,6 +4,7 @@
 
 #include <QBuffer>
 #include <QByteArray>
+#include <QFile>
 
 #include "qtd/logger.hpp"
 #include "qtd/utils.hpp"
@@ -11,6 +12,50 @@
 namespace qtd
 {
 
+nlohmann::json json_from_cbor_file(const std::string &fname)
+{
+  QFile file(QString::fromStdString(fname));
+
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    Logger::log()->error("json_from_cbor_file: Could not open file {} to load CBOR",
+                         fname);
+    return nlohmann::json(nlohmann::json::value_t::discarded);
+  }
+
+  // parsed straight from the page cache, no intermediate copy
+  nlohmann::json json;
+  uchar         *data = file.map(0, file.size());
+
+  if (data)
+  {
+    json = nlohmann::json::from_cbor(data, data + file.size(), true, false);
+    file.unmap(data);
+  }
+  else
+  {
+    QByteArray bytes = file.readAll();
+    json = nlohmann::json::from_cbor(bytes.begin(), bytes.end(), true, false);
+  }
+
+  if (json.is_discarded())
+    Logger::log()->error("json_from_cbor_file: invalid CBOR data in {}", fname);
+  else
+    Logger::log()->trace("json_from_cbor_file: JSON successfully loaded from {}", fname);
+
+  return json;
+}
+
+bool json_to_cbor_file(const nlohmann::json &json, const std::string &fname)
+{
+  std::vector<uint8_t> data = nlohmann::json::to_cbor(json);
+
+  QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char *>(data.data()),
+                                             qsizetype(data.size()));
+
+  return save_to_file(bytes, fname, true);
+}
+
 nlohmann::json json_from_file(const std::string &fname)
 {
   nlohmann::json json;
@@ -65,11 +110,9 @@ void json_to_file(const nlohmann::json &json,
     }
   }
 
-  std::ofstream outfile(fname);
-  if (outfile.is_open())
+  // temporary file + rename, an interrupted write leaves the previous file intact
+  if (save_to_file(QByteArray::fromStdString(final_json.dump(4)), fname, true))
   {
-    outfile << final_json.dump(4);
-    outfile.close();
     Logger::log()->trace("json_to_file: JSON successfully written to {}", fname);
   }
   else
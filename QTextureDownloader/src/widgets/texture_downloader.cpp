@@ -1,21 +1,28 @@
 /* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
    License. The full license is in the file LICENSE, distributed with this software. */
 #include <filesystem>
+#include <limits>
 
 #include <QApplication>
 #include <QCloseEvent>
 #include <QDir>
+#include <QEventLoop>
 #include <QFileDialog>
 #include <QGridLayout>
 #include <QHeaderView>
+#include <QInputDialog>
+#include <QLineEdit>
 #include <QMenu>
 #include <QMenuBar>
 #include <QMessageBox>
 #include <QProgressDialog>
+#include <QSettings>
 
 #include "qtd/config.hpp"
 #include "qtd/delegates.hpp"
 #include "qtd/logger.hpp"
+#include "qtd/network_session.hpp"
+#include "qtd/rate_limiter.hpp"
 #include "qtd/texture_downloader.hpp"
 #include "qtd/utils.hpp"
 
@@ -32,12 +39,53 @@ TextureDownloader::TextureDownloader(const std::string &_title, QWidget *parent)
   this->setMouseTracking(true);
   this->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
 
+  // network settings from the previous session, if any
+  {
+    QSettings    settings("olink", "QTextureDownloader");
+    RateLimiter *limiter = RateLimiter::get_limiter();
+    const auto  &config = QTD_CONFIG->network;
+
+    limiter->set_max_rate(RateClass::FOREGROUND,
+                          settings.value("max_rate_foreground",
+                                         qint64(config.max_rate_foreground))
+                              .toLongLong());
+    limiter->set_max_rate(RateClass::BACKGROUND,
+                          settings.value("max_rate_background",
+                                         qint64(config.max_rate_background))
+                              .toLongLong());
+
+    auto &mirror = QTD_CONFIG->mirror;
+
+    mirror.location = settings.value("mirror_location", mirror.location.c_str())
+                          .toString()
+                          .toStdString();
+    mirror.metadata = settings.value("mirror_metadata", mirror.metadata).toBool();
+
+    auto &storage = QTD_CONFIG->storage;
+
+    storage.max_bytes = settings.value("storage_max_bytes", qint64(storage.max_bytes))
+                            .toLongLong();
+
+    auto &prefetch = QTD_CONFIG->prefetch;
+
+    prefetch.enabled = settings.value("prefetch_enabled", prefetch.enabled).toBool();
+  }
+
+  this->thumbnail_loader = new ThumbnailLoader(this);
+  this->prefetcher = new Prefetcher(&this->texture_manager, this);
+
   this->setup_layout();
   this->setup_menu_bar();
   this->setup_connections();
 
+  // warm up the connections while the table is being filled
+  NetworkSession::get_session()->preconnect();
+
   this->texture_manager.load();
   this->update_table_rows();
+
+  this->prefetcher->set_resolution(this->res);
+  this->prefetcher->reset();
 }
 
 TextureDownloader::~TextureDownloader()
@@ -46,6 +94,83 @@ TextureDownloader::~TextureDownloader()
   this->texture_manager.save();
 }
 
+void TextureDownloader::choose_bandwidth_limits()
+{
+  RateLimiter *limiter = RateLimiter::get_limiter();
+  QSettings    settings("olink", "QTextureDownloader");
+
+  // in KiB/s, applied right away to the transfers in progress
+  for (const auto &[rate_class, label, key] :
+       {std::tuple(RateClass::FOREGROUND, "Foreground", "max_rate_foreground"),
+        std::tuple(RateClass::BACKGROUND, "Background", "max_rate_background")})
+  {
+    bool ok = false;
+    int  rate = QInputDialog::getInt(
+        this,
+        tr("Bandwidth limits"),
+        tr("%1 downloads, in KiB/s (0 for no limit):").arg(label),
+        int(limiter->get_max_rate(rate_class) / 1024),
+        0,
+        1024 * 1024,
+        64,
+        &ok);
+
+    if (!ok)
+      return;
+
+    limiter->set_max_rate(rate_class, int64_t(rate) * 1024);
+    settings.setValue(key, qint64(limiter->get_max_rate(rate_class)));
+  }
+}
+
+void TextureDownloader::choose_disk_budget()
+{
+  bool ok = false;
+  int  budget = QInputDialog::getInt(
+      this,
+      tr("Disk budget"),
+      tr("Texture files, in MiB (0 for no limit).\nThe least recently used files of the "
+         "unpinned textures are removed once exceeded:"),
+      int(QTD_CONFIG->storage.max_bytes / (1024 * 1024)),
+      0,
+      std::numeric_limits<int>::max(),
+      1024,
+      &ok);
+
+  if (!ok)
+    return;
+
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  this->texture_manager.set_disk_budget(int64_t(budget) * 1024 * 1024);
+  this->texture_manager.save();
+  QApplication::restoreOverrideCursor();
+
+  QSettings settings("olink", "QTextureDownloader");
+  settings.setValue("storage_max_bytes", qint64(QTD_CONFIG->storage.max_bytes));
+}
+
+void TextureDownloader::choose_mirror_location()
+{
+  bool    ok = false;
+  QString location = QInputDialog::getText(
+      this,
+      tr("Mirror"),
+      tr("Local directory or LAN server url (empty to disable):"),
+      QLineEdit::Normal,
+      QString::fromStdString(QTD_CONFIG->mirror.location),
+      &ok);
+
+  if (!ok)
+    return;
+
+  QTD_CONFIG->mirror.location = location.trimmed().toStdString();
+
+  QSettings settings("olink", "QTextureDownloader");
+  settings.setValue("mirror_location", QTD_CONFIG->mirror.location.c_str());
+
+  Logger::log()->info("Mirror set to: {}", QTD_CONFIG->mirror.location);
+}
+
 void TextureDownloader::choose_storage_path()
 {
   QString dir = QFileDialog::getExistingDirectory(
@@ -58,6 +183,7 @@ void TextureDownloader::choose_storage_path()
   {
     this->texture_manager.set_storage_path(dir.toStdString());
     this->update_table_rows();
+    this->prefetcher->reset();
 
     Logger::log()->info("Storage path set to: {}",
                         this->texture_manager.get_storage_path());
@@ -71,6 +197,40 @@ void TextureDownloader::closeEvent(QCloseEvent *event)
   Q_EMIT this->window_closed();
 }
 
+void TextureDownloader::filter_table_rows()
+{
+  if (this->search_edit->text().trimmed().isEmpty() || this->texture_manager.is_empty())
+  {
+    this->table_proxy->clear_matches();
+    return;
+  }
+
+  std::string text = this->search_edit->text().toStdString();
+
+  // matching IDs, through the search index, the rows are filtered by the proxy
+  this->table_proxy->set_matches(this->texture_manager.search_textures(text));
+}
+
+void TextureDownloader::populate_mirror()
+{
+  QString dir = QFileDialog::getExistingDirectory(
+      this,
+      tr("Select Mirror Directory"),
+      QString::fromStdString(QTD_CONFIG->mirror.location),
+      QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
+
+  if (dir.isEmpty())
+    return;
+
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  int count = this->texture_manager.populate_mirror(dir.toStdString());
+  QApplication::restoreOverrideCursor();
+
+  QMessageBox::information(this,
+                           tr("Mirror"),
+                           tr("%1 file(s) mirrored to %2").arg(count).arg(dir));
+}
+
 void TextureDownloader::purge_database()
 {
   Logger::log()->trace("TextureDownloader::purge_database");
@@ -104,6 +264,7 @@ void TextureDownloader::purge_database()
   this->texture_manager = TextureManager();
   this->texture_manager.save();
   this->update_table_rows();
+  this->prefetcher->reset();
 
   progress.close();
 }
@@ -112,19 +273,8 @@ void TextureDownloader::retrieve_selected_textures()
 {
   Logger::log()->trace("TextureDownloader::retrieve_selected_textures");
 
-  std::vector<std::string> texture_paths;
-
-  // block UI
-  QProgressDialog progress(tr("Retrieving textures..."), QString(), 0, 0, this);
-  progress.setWindowModality(Qt::ApplicationModal);
-  progress.setCancelButton(nullptr);
-  progress.setMinimumDuration(0); // show immediately
-  progress.show();
-
-  // process events so dialog is painted before heavy work
-  QApplication::processEvents();
-
-  // list checked items
+  // list checked items, grouped by material
+  std::map<std::string, std::vector<TextureType>> materials;
 
   for (int row = 0; row < this->table_model->rowCount(); ++row)
     for (int col = 0; col < this->table_model->columnCount(); ++col)
@@ -150,14 +300,72 @@ void TextureDownloader::retrieve_selected_textures()
 
         // retrieve ID
         QStandardItem *item_id = this->table_model->item(row, 2); // TODO hardcoded
-        TextureKey     key(item_id->text().toStdString(), type, this->res);
-        std::string    path = this->texture_manager.try_download_texture(key);
-
-        if (!path.empty())
-          texture_paths.push_back(path);
+        materials[item_id->text().toStdString()].push_back(type);
       }
     }
 
+  std::vector<std::string> texture_paths;
+
+  if (materials.empty())
+  {
+    Q_EMIT this->textures_retrieved(texture_paths);
+    return;
+  }
+
+  // block UI
+  QProgressDialog progress(tr("Retrieving textures..."),
+                           QString(),
+                           0,
+                           int(materials.size()),
+                           this);
+  progress.setWindowModality(Qt::ApplicationModal);
+  progress.setCancelButton(nullptr);
+  progress.setMinimumDuration(0); // show immediately
+  progress.show();
+
+  // materials are retrieved concurrently, each one is reported as soon as it is done
+  std::map<std::string, int64_t> received_bytes; // by material
+  size_t                         n_done = 0;
+  QEventLoop                     loop;
+
+  for (auto &e : materials)
+  {
+    const std::string id = e.first;
+
+    this->texture_manager.retrieve_material(
+        id,
+        e.second,
+        this->res,
+        [this, &texture_paths, &n_done, &materials, &progress, &loop](
+            const MaterialResult &result)
+        {
+          std::vector<std::string> paths;
+          for (auto &[type, path] : result.paths)
+            paths.push_back(path);
+
+          texture_paths.insert(texture_paths.end(), paths.begin(), paths.end());
+
+          Q_EMIT this->material_retrieved(result.id, paths, result.complete);
+
+          progress.setValue(int(++n_done));
+          if (n_done == materials.size())
+            loop.quit();
+        },
+        [&received_bytes, &progress, id](int64_t received, int64_t /* total */)
+        {
+          received_bytes[id] = received;
+
+          int64_t sum = 0;
+          for (auto &[_, bytes] : received_bytes)
+            sum += bytes;
+
+          progress.setLabelText(
+              tr("Retrieving textures... (%1 MB)").arg(sum / (1024 * 1024)));
+        });
+  }
+
+  loop.exec();
+
   // free selection
   this->unchecked_all_items();
 
@@ -177,6 +385,8 @@ void TextureDownloader::set_texture_res(const TextureRes &new_res)
   this->res = new_res;
   this->update_table_rows();
   this->table_view->sortByColumn(1, Qt::DescendingOrder);
+
+  this->prefetcher->set_resolution(this->res);
 }
 
 void TextureDownloader::setup_connections()
@@ -210,6 +420,16 @@ void TextureDownloader::setup_connections()
                   this->set_texture_res(new_res);
                 });
 
+  this->connect(this->search_edit,
+                &QLineEdit::textChanged,
+                this,
+                &TextureDownloader::filter_table_rows);
+
+  this->connect(this->thumbnail_loader,
+                &ThumbnailLoader::thumbnails_ready,
+                this,
+                &TextureDownloader::update_thumbnails);
+
   this->connect(
       this->table_model,
       &QStandardItemModel::itemChanged,
@@ -228,8 +448,8 @@ void TextureDownloader::setup_connections()
 
             // TODO hardcoded
             std::string tex_id = this->table_model->item(row, 2)->text().toStdString();
-            this->texture_manager.get_textures().at(tex_id).set_is_pinned(
-                item->checkState());
+            this->texture_manager.set_is_pinned(tex_id, item->checkState());
+            this->prefetcher->reset();
           }
         }
       });
@@ -271,6 +491,12 @@ void TextureDownloader::setup_layout()
   if (idx >= 0)
     this->combo_res->setCurrentIndex(idx);
 
+  // search
+  this->search_edit = new QLineEdit();
+  this->search_edit->setPlaceholderText("Search names, tags and sources...");
+  this->search_edit->setClearButtonEnabled(true);
+  layout->addWidget(this->search_edit, 0, col++);
+
   // --- table
 
   this->table_model = new QStandardItemModel(0, 0, this);
@@ -285,8 +511,12 @@ void TextureDownloader::setup_layout()
 
   this->table_model->setHorizontalHeaderLabels(labels);
 
+  // sorted and filtered by the proxy
+  this->table_proxy = new TextureFilterProxy(2, this); // TODO hardcoded
+  this->table_proxy->setSourceModel(this->table_model);
+
   this->table_view = new QTableView(this);
-  this->table_view->setModel(this->table_model);
+  this->table_view->setModel(this->table_proxy);
   this->table_view->setSortingEnabled(true);
   this->table_view->horizontalHeader()->setStretchLastSection(true);
   this->table_view->setEditTriggers(QAbstractItemView::NoEditTriggers);
@@ -327,6 +557,87 @@ void TextureDownloader::setup_menu_bar()
                   &TextureDownloader::choose_storage_path);
   }
 
+  {
+    QAction *action = new QAction(tr("&Disk budget"), this);
+    file_menu->addAction(action);
+
+    this->connect(action,
+                  &QAction::triggered,
+                  this,
+                  &TextureDownloader::choose_disk_budget);
+  }
+
+  file_menu->addSeparator();
+
+  // mirror
+  {
+    QAction *action = new QAction(tr("&Mirror location"), this);
+    file_menu->addAction(action);
+
+    this->connect(action,
+                  &QAction::triggered,
+                  this,
+                  &TextureDownloader::choose_mirror_location);
+  }
+
+  {
+    QAction *action = new QAction(tr("Use mirror for &metadata"), this);
+    action->setCheckable(true);
+    action->setChecked(QTD_CONFIG->mirror.metadata);
+    file_menu->addAction(action);
+
+    this->connect(action,
+                  &QAction::toggled,
+                  this,
+                  [](bool checked)
+                  {
+                    QTD_CONFIG->mirror.metadata = checked;
+
+                    QSettings settings("olink", "QTextureDownloader");
+                    settings.setValue("mirror_metadata", checked);
+                  });
+  }
+
+  {
+    QAction *action = new QAction(tr("&Populate mirror"), this);
+    file_menu->addAction(action);
+
+    this->connect(action,
+                  &QAction::triggered,
+                  this,
+                  &TextureDownloader::populate_mirror);
+  }
+
+  // bandwidth
+  {
+    QAction *action = new QAction(tr("&Bandwidth limits"), this);
+    file_menu->addAction(action);
+
+    this->connect(action,
+                  &QAction::triggered,
+                  this,
+                  &TextureDownloader::choose_bandwidth_limits);
+  }
+
+  // prefetching
+  {
+    QAction *action = new QAction(tr("Prefetch &pinned textures"), this);
+    action->setCheckable(true);
+    action->setChecked(this->prefetcher->is_enabled());
+    file_menu->addAction(action);
+
+    this->connect(action,
+                  &QAction::toggled,
+                  this,
+                  [this](bool checked)
+                  {
+                    this->prefetcher->set_enabled(checked);
+
+                    QSettings settings("olink", "QTextureDownloader");
+                    settings.setValue("prefetch_enabled", checked);
+                  });
+  }
+
   file_menu->addSeparator();
 
   // purge
@@ -391,6 +702,7 @@ void TextureDownloader::update_sources()
   this->texture_manager.update();
   this->texture_manager.save();
   this->update_table_rows();
+  this->prefetcher->reset();
 
   progress.close();
 }
@@ -399,6 +711,12 @@ void TextureDownloader::update_table_rows()
 {
   Logger::log()->trace("TextureDownloader::update_table_rows");
 
+  // pending thumbnails are for the rows about to be removed
+  this->thumbnail_loader->cancel();
+  this->thumbnail_items.clear();
+
+  // filled detached from the proxy, which then sorts and filters the rows only once
+  this->table_proxy->setSourceModel(nullptr);
   this->table_model->removeRows(0, this->table_model->rowCount());
 
   // if the database is empty write an hint on how to update sources
@@ -408,6 +726,9 @@ void TextureDownloader::update_table_rows()
         {new QStandardItem(),
          new QStandardItem(
              "Use the menu bar 'Texture sources' to populate the texture database.")});
+    this->table_proxy->setSourceModel(this->table_model);
+    this->filter_table_rows();
+
     // TODO hardcoded
     this->table_view->setSpan(0, 1, 1, 7);
     return;
@@ -420,18 +741,15 @@ void TextureDownloader::update_table_rows()
   {
     QList<QStandardItem *> items;
 
-    // thumbnail
+    // thumbnail, set once decoded (see update_thumbnails)
     QStandardItem *img_item = new QStandardItem;
-    QImage         img = QImage(this->texture_manager.get_thumbnail_path(id).c_str());
-
-    if (!img.isNull())
-    {
-      QPixmap pix = QPixmap::fromImage(img);
-      img_item->setData(pix, Qt::DecorationRole);
-    }
-
     items.append(img_item);
 
+    this->thumbnail_items[id] = img_item;
+    this->thumbnail_loader->request(id,
+                                    this->texture_manager.get_thumbnail_path(id),
+                                    tex.get_thumbnail_url());
+
     {
       QStandardItem *check_item = new QStandardItem;
       check_item->setCheckable(true);
@@ -463,11 +781,27 @@ void TextureDownloader::update_table_rows()
     this->table_model->appendRow(items);
   }
 
+  this->table_proxy->setSourceModel(this->table_model);
+
   if (this->first_table_view_creation)
   {
     this->table_view->sortByColumn(1, Qt::DescendingOrder);
     this->first_table_view_creation = false;
   }
+
+  this->filter_table_rows();
+}
+
+void TextureDownloader::update_thumbnails(const ThumbnailBatch &batch)
+{
+  // images are already decoded and scaled, only the conversion is done here
+  for (auto &[id, image] : batch)
+  {
+    auto it = this->thumbnail_items.find(id);
+
+    if (it != this->thumbnail_items.end())
+      it->second->setData(QPixmap::fromImage(image), Qt::DecorationRole);
+  }
 }
 
 } // namespace qtd
@@ -0,0 +1,49 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include "qtd/texture_filter_proxy.hpp"
+
+namespace qtd
+{
+
+TextureFilterProxy::TextureFilterProxy(int _id_column, QObject *parent)
+    : QSortFilterProxyModel(parent), id_column(_id_column)
+{
+}
+
+void TextureFilterProxy::clear_matches()
+{
+  if (this->show_all)
+    return;
+
+  this->show_all = true;
+  this->matches.clear();
+  this->invalidateFilter();
+}
+
+bool TextureFilterProxy::filterAcceptsRow(int                source_row,
+                                          const QModelIndex &source_parent) const
+{
+  if (this->show_all)
+    return true;
+
+  // the item text is implicitly shared, the ID is not copied
+  QModelIndex index = this->sourceModel()->index(source_row,
+                                                 this->id_column,
+                                                 source_parent);
+
+  return this->matches.contains(index.data().toString());
+}
+
+void TextureFilterProxy::set_matches(const std::vector<std::string_view> &ids)
+{
+  this->show_all = false;
+  this->matches.clear();
+  this->matches.reserve(qsizetype(ids.size()));
+
+  for (auto &id : ids)
+    this->matches.insert(QString::fromUtf8(id.data(), qsizetype(id.size())));
+
+  this->invalidateFilter();
+}
+
+} // namespace qtd
@@ -0,0 +1,155 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include <QCoreApplication>
+
+#include "qtd/texture_manager.hpp"
+
+#include "synthetic_catalog.hpp"
+
+// heap allocations of the catalog read paths: the reads done for each row when the
+// table is filled, and the lookups done to resolve a texture key before a download.
+// Both are expected to allocate nothing
+//
+// usage: bench_allocations [number of assets, default 50000]
+
+static std::atomic<size_t> n_allocations = 0;
+
+void *operator new(std::size_t size)
+{
+  n_allocations++;
+
+  if (void *ptr = std::malloc(size ? size : 1))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+// allocations and time (in microseconds) per call of 'fct', over 'n' calls, returns the
+// allocations of the calls only (the label is a literal, nothing allocated around them)
+template <typename F> size_t measure(const char *label, size_t n, F fct)
+{
+  size_t n0 = n_allocations;
+  auto   t0 = std::chrono::steady_clock::now();
+
+  for (size_t k = 0; k < n; k++)
+    fct(k);
+
+  auto   t1 = std::chrono::steady_clock::now();
+  size_t n_calls = n_allocations - n0;
+  double dt = std::chrono::duration<double, std::micro>(t1 - t0).count();
+
+  std::cout << label << ": " << double(n_calls) / double(n) << " allocation(s), "
+            << dt / double(n) << " us\n";
+
+  return n_calls;
+}
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+
+  int n_assets = argc > 1 ? std::atoi(argv[1]) : 50000;
+
+  std::filesystem::path dir = std::filesystem::temp_directory_path() /
+                              "bench_allocations";
+
+  qtd::TextureManager manager(dir.string());
+  qtd::TextureMap    &textures = manager.get_textures();
+  auto                store = std::make_shared<qtd::TextureDetailStore>();
+
+  for (int k = 0; k < n_assets; k++)
+  {
+    qtd::Texture tex;
+    tex.set_details_store(store);
+    tex.json_from(make_texture(k));
+    textures[tex.get_id()] = tex;
+  }
+
+  std::vector<const qtd::Texture *> rows;
+  std::vector<qtd::TextureKey>      keys;
+
+  for (auto &[id, tex] : textures)
+  {
+    rows.push_back(&tex);
+
+    for (auto type : qtd::all_texture_types)
+      keys.push_back({id, type, qtd::TextureRes(keys.size() % qtd::TEXTURE_RES_COUNT)});
+  }
+
+  std::cout << "synthetic catalog: " << n_assets << " assets\n";
+
+  // --- table fill, same reads as TextureDownloader::update_table_rows
+  size_t checksum = 0;
+
+  size_t n_table = measure(
+      "table fill (per row)",
+      rows.size(),
+      [&](size_t k)
+      {
+        const qtd::Texture &tex = *rows[k];
+
+        checksum += tex.get_id().size() + tex.get_name().size() +
+                    tex.get_source().size() + tex.get_thumbnail_url().size() +
+                    tex.get_is_pinned();
+
+        for (auto type : qtd::all_texture_types)
+          checksum += tex.has_texture(type, qtd::TextureRes::R2K);
+      });
+
+  // --- download resolution: texture, availability, expected file and record key (the
+  // --- key buffer is reused, as TextureManager does)
+  std::string buffer;
+  buffer.reserve(256);
+
+  size_t n_lookup = measure(
+      "download resolution (per key)",
+      keys.size(),
+      [&](size_t k)
+      {
+        const qtd::TextureKey &key = keys[k];
+        const qtd::Texture    *tex = manager.get_texture(key.id);
+
+        if (tex && tex->has_texture(key.type, key.res))
+          checksum += tex->get_texture_file_info(key.type, key.res).size;
+
+        checksum += key.to_string(buffer).size();
+      });
+
+  // --- for reference, what the lookups used to do
+  measure("  key string (per key)",
+          keys.size(),
+          [&](size_t k) { checksum += keys[k].to_string().size(); });
+
+  measure("  texture copy (per key)",
+          keys.size(),
+          [&](size_t k)
+          {
+            qtd::Texture tex = textures.at(keys[k].id);
+            checksum += tex.get_name().size();
+          });
+
+  std::cout << "checksum: " << checksum << "\n";
+
+  std::filesystem::remove_all(dir);
+
+  if (n_table || n_lookup)
+  {
+    std::cerr << "error: pure lookups allocate (" << n_table << " / " << n_lookup
+              << ")\n";
+    return 1;
+  }
+
+  return 0;
+}
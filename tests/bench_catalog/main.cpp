@@ -0,0 +1,147 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+
+#include <QCoreApplication>
+
+#include "qtd/texture.hpp"
+#include "qtd/utils.hpp"
+
+#include "synthetic_catalog.hpp"
+
+// catalog startup benchmark: a synthetic catalog is saved and loaded back in both the
+// JSON (previous versions) and the binary (CBOR) formats, then as the summary tier
+// loaded at startup (details being loaded on demand, with their urls as templates)
+//
+// usage: bench_catalog [number of assets, default 50000]
+
+// best of a few runs, in milliseconds
+double time_ms(const std::function<void()> &fct, int n_runs = 3)
+{
+  double best = -1.0;
+
+  for (int k = 0; k < n_runs; k++)
+  {
+    auto   t0 = std::chrono::steady_clock::now();
+    fct();
+    double dt = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - t0)
+                    .count();
+    best = best < 0.0 ? dt : std::min(best, dt);
+  }
+
+  return best;
+}
+
+// same as TextureManager::json_from
+std::map<std::string, qtd::Texture> build_textures(const nlohmann::json &json)
+{
+  std::map<std::string, qtd::Texture> textures;
+  auto                                store = std::make_shared<qtd::TextureDetailStore>();
+
+  for (auto &[key, value] : json.items())
+  {
+    textures[key] = qtd::Texture();
+    textures[key].set_details_store(store);
+    textures[key].json_from(value);
+  }
+
+  return textures;
+}
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+
+  int n_assets = argc > 1 ? std::atoi(argv[1]) : 50000;
+
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "bench_catalog";
+  std::filesystem::create_directories(dir);
+
+  std::string json_path = (dir / "db.json").string();
+  std::string cbor_path = (dir / "db.cbor").string();
+  std::string summary_path = (dir / "db_summary.cbor").string();
+
+  std::cout << "synthetic catalog: " << n_assets << " assets\n";
+  nlohmann::json catalog = make_catalog(n_assets);
+
+  // --- save
+  double t_save_json = time_ms([&]() { qtd::json_to_file(catalog, json_path); });
+  double t_save_cbor = time_ms([&]() { qtd::json_to_cbor_file(catalog, cbor_path); });
+
+  // --- load (parsing + textures)
+  size_t n_json = 0;
+  size_t n_cbor = 0;
+
+  double t_load_json = time_ms(
+      [&]() { n_json = build_textures(qtd::json_from_file(json_path)).size(); });
+  double t_load_cbor = time_ms(
+      [&]() { n_cbor = build_textures(qtd::json_from_cbor_file(cbor_path)).size(); });
+
+  // --- summary tier (same as TextureManager::json_to) and details with url templates,
+  // --- against the same data with full urls
+  nlohmann::json summary;
+  size_t         details_size = 0;
+  size_t         details_size_urls = 0;
+
+  for (auto &[key, tex] : build_textures(catalog))
+  {
+    summary[key] = tex.json_to();
+    details_size += nlohmann::json::to_cbor(tex.get_details().json_to()).size();
+
+    nlohmann::json full_urls = tex.get_details().json_to();
+
+    for (auto &k : {"diffuse_urls", "normal_urls", "displacement_urls"})
+      full_urls[k] = catalog[key][k];
+
+    details_size_urls += nlohmann::json::to_cbor(full_urls).size();
+  }
+
+  qtd::json_to_cbor_file(summary, summary_path);
+
+  size_t n_summary = 0;
+  double t_load_summary = time_ms(
+      [&]()
+      { n_summary = build_textures(qtd::json_from_cbor_file(summary_path)).size(); });
+
+  // --- parsing only
+  double t_parse_json = time_ms([&]() { qtd::json_from_file(json_path); });
+  double t_parse_cbor = time_ms([&]() { qtd::json_from_cbor_file(cbor_path); });
+
+  if (n_json != size_t(n_assets) || n_cbor != size_t(n_assets) ||
+      n_summary != size_t(n_assets))
+  {
+    std::cerr << "error: " << n_json << " / " << n_cbor << " / " << n_summary
+              << " assets loaded\n";
+    return 1;
+  }
+
+  auto report = [](const std::string &label, double t_json, double t_cbor)
+  {
+    std::cout << label << ": JSON " << t_json << " ms, CBOR " << t_cbor << " ms (x"
+              << t_json / t_cbor << ")\n";
+  };
+
+  std::cout << "file size: JSON " << std::filesystem::file_size(json_path) / 1024
+            << " KiB, CBOR " << std::filesystem::file_size(cbor_path) / 1024 << " KiB\n";
+
+  report("save ", t_save_json, t_save_cbor);
+  report("parse", t_parse_json, t_parse_cbor);
+  report("load ", t_load_json, t_load_cbor);
+
+  std::cout << "summary tier: " << std::filesystem::file_size(summary_path) / 1024
+            << " KiB, load " << t_load_summary << " ms (x" << t_load_cbor / t_load_summary
+            << " vs full CBOR)\n";
+  std::cout << "details tier: " << details_size / n_assets << " bytes per asset ("
+            << details_size_urls / n_assets << " with full urls)\n";
+
+  std::filesystem::remove_all(dir);
+
+  return 0;
+}
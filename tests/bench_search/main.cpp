@@ -0,0 +1,144 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+
+#include "qtd/search_index.hpp"
+#include "qtd/texture.hpp"
+
+#include "synthetic_catalog.hpp"
+
+// search index build and query times on a synthetic catalog. The prefix queries are
+// checked against a scan of the catalog, timings are only reported
+//
+// usage: bench_search [number of assets, default 50000]
+
+// lower case words of the name, source and tags of a catalog entry
+std::set<std::string> get_words(const nlohmann::json &tex)
+{
+  std::vector<std::string> texts = {tex["name"], tex["source"]};
+  std::set<std::string>    words;
+
+  for (auto &tag : tex["tags"])
+    texts.push_back(tag);
+
+  for (auto &text : texts)
+  {
+    std::string word;
+
+    for (char c : text + " ")
+      if (std::isalnum(static_cast<unsigned char>(c)))
+        word.push_back(char(std::tolower(static_cast<unsigned char>(c))));
+      else if (!word.empty())
+      {
+        words.insert(word);
+        word.clear();
+      }
+  }
+
+  return words;
+}
+
+// IDs of the entries with a word starting with each of the query words
+std::set<std::string> scan(const nlohmann::json                  &catalog,
+                           const std::vector<std::set<std::string>> &entry_words,
+                           const std::vector<std::string>           &query)
+{
+  std::set<std::string> ids;
+  size_t                k = 0;
+
+  for (auto &[id, tex] : catalog.items())
+  {
+    const std::set<std::string> &words = entry_words[k++];
+
+    if (std::all_of(query.begin(),
+                    query.end(),
+                    [&words](const std::string &q)
+                    {
+                      return std::any_of(words.begin(),
+                                         words.end(),
+                                         [&q](const std::string &w)
+                                         { return w.starts_with(q); });
+                    }))
+      ids.insert(id);
+  }
+
+  return ids;
+}
+
+int main(int argc, char *argv[])
+{
+  int n_assets = argc > 1 ? std::atoi(argv[1]) : 50000;
+
+  nlohmann::json                     catalog = make_catalog(n_assets);
+  std::vector<std::set<std::string>> entry_words;
+  qtd::SearchIndex                   index;
+  double                             dt_build = 0.0;
+
+  for (auto &[id, value] : catalog.items())
+  {
+    qtd::Texture tex;
+    tex.json_from(value);
+    entry_words.push_back(get_words(value));
+
+    auto t0 = std::chrono::steady_clock::now();
+    index.add(id, tex);
+    dt_build += std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - t0)
+                    .count();
+  }
+
+  std::cout << "synthetic catalog: " << n_assets << " assets\n";
+  std::cout << "index build: " << dt_build << " ms\n";
+
+  // prefix (checked), typos (fuzzy) and no match
+  struct Query
+  {
+    std::vector<std::string> words;
+    bool                     checked;
+  };
+
+  int n_errors = 0;
+
+  for (auto &query : {Query{{"ro"}, true},
+                      Query{{"concr"}, true},
+                      Query{{"brick", "wood"}, true},
+                      Query{{"poly", "bark", "1"}, true},
+                      Query{{"zzzz"}, true},
+                      Query{{"concret"}, false},
+                      Query{{"plastr"}, false},
+                      Query{{"brik", "wod"}, false}})
+  {
+    std::string text;
+    for (auto &word : query.words)
+      text += word + " ";
+
+    constexpr int                 n_runs = 100;
+    std::vector<std::string_view> ids;
+    auto                          t0 = std::chrono::steady_clock::now();
+
+    for (int r = 0; r < n_runs; r++)
+      ids = index.search(text);
+
+    double dt = std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - t0)
+                    .count() /
+                n_runs;
+
+    std::cout << "'" << text << "': " << ids.size() << " match(es), " << dt << " us\n";
+
+    if (query.checked &&
+        std::set<std::string>(ids.begin(), ids.end()) !=
+            scan(catalog, entry_words, query.words))
+    {
+      std::cerr << "error: wrong matches for '" << text << "'\n";
+      n_errors++;
+    }
+  }
+
+  return n_errors ? 1 : 0;
+}
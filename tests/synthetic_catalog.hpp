@@ -0,0 +1,82 @@
+/* Copyright (c) 2025 Otto Link. Distributed under the terms of the GNU General Public
+   License. The full license is in the file LICENSE, distributed with this software. */
+#pragma once
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+// synthetic Poly Haven catalog shared by the benchmarks. Entries are complete (summary
+// and details together, as written by the previous versions), with four resolutions
+// per map and names and tags drawn from a small vocabulary
+
+inline const std::vector<std::string> synthetic_words = {"rock",
+                                                         "ground",
+                                                         "wood",
+                                                         "metal",
+                                                         "brick",
+                                                         "fabric",
+                                                         "plaster",
+                                                         "concrete",
+                                                         "sand",
+                                                         "leaves",
+                                                         "bark",
+                                                         "tiles"};
+
+// catalog entry of the k-th asset, its key being its "id"
+inline nlohmann::json make_texture(int k)
+{
+  const std::vector<std::string> &words = synthetic_words;
+
+  std::string id = "asset_" + std::to_string(k);
+  std::string base = "https://dl.polyhaven.org/file/ph-assets/Textures/png/";
+  std::string name = words[k % words.size()] + " " +
+                     words[(k / words.size()) % words.size()] + " " +
+                     std::to_string(k);
+
+  nlohmann::json tex = {{"id", "PolyHaven_" + id},
+                        {"name", name},
+                        {"source", "PolyHaven"},
+                        {"id_from_source", id},
+                        {"thumbnail_url",
+                         "https://cdn.polyhaven.com/asset_img/thumbs/" + id +
+                             ".png?width=256&height=256"},
+                        {"fingerprint", std::to_string(k * 7919) + "_1700000000"},
+                        {"tags",
+                         {words[(k * 7) % words.size()],
+                          words[(k * 5) % words.size()],
+                          "natural",
+                          "rough",
+                          "outdoor"}},
+                        {"is_pinned", k % 100 == 0}};
+
+  for (auto &[urls, infos, map] : {std::tuple("diffuse_urls", "diffuse_infos", "diff"),
+                                   std::tuple("normal_urls", "normal_infos", "nor_gl"),
+                                   std::tuple("displacement_urls",
+                                              "displacement_infos",
+                                              "disp")})
+    for (auto res : {"1k", "2k", "4k", "8k"})
+    {
+      tex[urls][res] = base + res + "/" + id + "/" + id + "_" + map + "_" + res + ".png";
+      tex[infos][res] = {{"size", 1000000 + k}, {"md5", std::string(32, 'a' + k % 26)}};
+    }
+
+  return tex;
+}
+
+// whole catalog, entries by ID
+inline nlohmann::json make_catalog(int n_assets)
+{
+  nlohmann::json json;
+
+  for (int k = 0; k < n_assets; k++)
+  {
+    nlohmann::json tex = make_texture(k);
+    std::string    id = tex["id"];
+
+    json[id] = std::move(tex);
+  }
+
+  return json;
+}